@@ -0,0 +1,286 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include "detex.h"
+#include "block-cache.h"
+
+#define DETEX_BLOCK_CACHE_MAGIC 0x43425844
+#define DETEX_BLOCK_CACHE_VERSION 1
+#define DETEX_BLOCK_CACHE_FILENAME "detex-block-cache.bin"
+#define DETEX_BLOCK_CACHE_MIN_ENTRIES 1024
+// Maximum number of slots that are probed for a key.
+#define DETEX_BLOCK_CACHE_PROBE_LENGTH 8
+
+struct BlockCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nu_entries;
+	// Incremented for every insertion and hit; used as the last use stamp of entries.
+	uint32_t clock;
+};
+
+struct BlockCacheEntry {
+	uint64_t key[2];
+	uint8_t bitstring[16];
+	// Last use stamp, zero for an empty slot.
+	uint32_t stamp;
+	// Checksum of the key and the compressed block, so that entries that are partially
+	// written (for example when another process uses the same cache file) are ignored.
+	uint32_t checksum;
+};
+
+struct detexBlockCache {
+	int fd;
+	size_t file_size;
+	uint8_t *data;
+	BlockCacheHeader *header;
+	BlockCacheEntry *entries;
+	pthread_mutex_t mutex;
+};
+
+static DETEX_INLINE_ONLY uint64_t MixBits64(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static DETEX_INLINE_ONLY uint64_t RotateLeft64(uint64_t x, int n) {
+	return (x << n) | (x >> (64 - n));
+}
+
+void detexCalculateBlockCacheKey(const uint8_t *data, int size, const uint64_t *seed, uint64_t *key) {
+	uint64_t h1 = seed[0];
+	uint64_t h2 = seed[1];
+	for (int i = 0; i < size; i += 8) {
+		// Load up to eight bytes in little-endian order.
+		uint64_t k = 0;
+		for (int j = 0; j < 8 && i + j < size; j++)
+			k |= (uint64_t)data[i + j] << (j * 8);
+		h1 ^= RotateLeft64(k * 0x87C37B91114253D5ULL, 31) * 0x4CF5AD432745937FULL;
+		h1 = RotateLeft64(h1, 27) + h2;
+		h1 = h1 * 5 + 0x52DCE729;
+		h2 ^= RotateLeft64(k * 0x4CF5AD432745937FULL, 33) * 0x87C37B91114253D5ULL;
+		h2 = RotateLeft64(h2, 31) + h1;
+		h2 = h2 * 5 + 0x38495AB5;
+	}
+	h1 ^= (uint64_t)size;
+	h2 ^= (uint64_t)size;
+	h1 += h2;
+	h2 += h1;
+	h1 = MixBits64(h1);
+	h2 = MixBits64(h2);
+	h1 += h2;
+	h2 += h1;
+	key[0] = h1;
+	key[1] = h2;
+}
+
+static uint32_t CalculateEntryChecksum(const BlockCacheEntry *entry) {
+	uint64_t h = MixBits64(entry->key[0] ^ 0x9E3779B97F4A7C15ULL);
+	h = MixBits64(h ^ entry->key[1]);
+	h = MixBits64(h ^ *(uint64_t *)&entry->bitstring[0]);
+	h = MixBits64(h ^ *(uint64_t *)&entry->bitstring[8]);
+	// Never return zero so that a cleared entry is always invalid.
+	return (uint32_t)(h >> 32) | 1;
+}
+
+static void ResetBlockCache(detexBlockCache *cache, uint32_t nu_entries) {
+	cache->header->magic = DETEX_BLOCK_CACHE_MAGIC;
+	cache->header->version = DETEX_BLOCK_CACHE_VERSION;
+	cache->header->nu_entries = nu_entries;
+	cache->header->clock = 0;
+}
+
+// Open the cache file at path and lock it exclusively. Because a file that is replaced by
+// another process while waiting for the lock is no longer the cache file, retry until the
+// locked file is the one at path.
+static int OpenAndLockBlockCacheFile(const char *path, struct stat *st) {
+	for (;;) {
+		int fd = open(path, O_RDWR | O_CREAT, 0666);
+		if (fd < 0)
+			return -1;
+		struct stat path_st;
+		if (flock(fd, LOCK_EX) != 0 || fstat(fd, st) != 0) {
+			close(fd);
+			return -1;
+		}
+		if (stat(path, &path_st) == 0 && path_st.st_dev == st->st_dev && path_st.st_ino == st->st_ino)
+			return fd;
+		close(fd);
+	}
+}
+
+// Create a new, empty (zeroed) cache file and move it in place of the file at path. Other
+// processes that have the old file mapped keep using it undisturbed, rather than having it
+// truncated or cleared under them. The new file is returned locked.
+static int ReplaceBlockCacheFile(const char *path, size_t file_size) {
+	size_t temp_path_length = strlen(path) + 16;
+	char *temp_path = (char *)malloc(temp_path_length);
+	snprintf(temp_path, temp_path_length, "%s.%d", path, (int)getpid());
+	int fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd >= 0 && (flock(fd, LOCK_EX) != 0 || ftruncate(fd, file_size) != 0 ||
+	rename(temp_path, path) != 0)) {
+		close(fd);
+		unlink(temp_path);
+		fd = -1;
+	}
+	free(temp_path);
+	return fd;
+}
+
+detexBlockCache *detexOpenBlockCache(const char *directory, uint64_t max_size) {
+	if (mkdir(directory, 0777) != 0 && errno != EEXIST)
+		return NULL;
+	// Use the largest power of two number of entries that fits within the size limit.
+	uint32_t nu_entries = DETEX_BLOCK_CACHE_MIN_ENTRIES;
+	while (nu_entries < 0x40000000 && sizeof(BlockCacheHeader) + (uint64_t)nu_entries * 2 *
+	sizeof(BlockCacheEntry) <= max_size)
+		nu_entries *= 2;
+	size_t file_size = sizeof(BlockCacheHeader) + (size_t)nu_entries * sizeof(BlockCacheEntry);
+	size_t path_length = strlen(directory) + strlen(DETEX_BLOCK_CACHE_FILENAME) + 2;
+	char *path = (char *)malloc(path_length);
+	snprintf(path, path_length, "%s/%s", directory, DETEX_BLOCK_CACHE_FILENAME);
+	// Hold an exclusive lock on the file while checking and (re)initializing it, so that
+	// processes opening the cache concurrently do not initialize it twice.
+	struct stat st;
+	int fd = OpenAndLockBlockCacheFile(path, &st);
+	if (fd < 0) {
+		free(path);
+		return NULL;
+	}
+	void *data = MAP_FAILED;
+	if ((size_t)st.st_size == file_size)
+		data = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data != MAP_FAILED) {
+		const BlockCacheHeader *header = (const BlockCacheHeader *)data;
+		if (header->magic != DETEX_BLOCK_CACHE_MAGIC || header->version != DETEX_BLOCK_CACHE_VERSION ||
+		header->nu_entries != nu_entries) {
+			munmap(data, file_size);
+			data = MAP_FAILED;
+		}
+	}
+	// A file of a different size or format is replaced by a new file with empty entries.
+	bool replaced = false;
+	if (data == MAP_FAILED) {
+		int new_fd = ReplaceBlockCacheFile(path, file_size);
+		close(fd);
+		fd = new_fd;
+		if (fd >= 0)
+			data = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		replaced = true;
+	}
+	free(path);
+	if (data == MAP_FAILED) {
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+	detexBlockCache *cache = (detexBlockCache *)malloc(sizeof(detexBlockCache));
+	cache->fd = fd;
+	cache->file_size = file_size;
+	cache->data = (uint8_t *)data;
+	cache->header = (BlockCacheHeader *)data;
+	cache->entries = (BlockCacheEntry *)(cache->data + sizeof(BlockCacheHeader));
+	pthread_mutex_init(&cache->mutex, NULL);
+	if (replaced)
+		ResetBlockCache(cache, nu_entries);
+	flock(fd, LOCK_UN);
+	return cache;
+}
+
+void detexCloseBlockCache(detexBlockCache *cache) {
+	munmap(cache->data, cache->file_size);
+	close(cache->fd);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache);
+}
+
+static DETEX_INLINE_ONLY uint32_t AdvanceClock(detexBlockCache *cache) {
+	uint32_t stamp = cache->header->clock + 1;
+	// Skip zero, which marks empty slots.
+	if (stamp == 0)
+		stamp = 1;
+	cache->header->clock = stamp;
+	return stamp;
+}
+
+bool detexLookupBlockCache(detexBlockCache *cache, const uint64_t *key, uint8_t *bitstring,
+int block_size) {
+	uint32_t mask = cache->header->nu_entries - 1;
+	bool found = false;
+	pthread_mutex_lock(&cache->mutex);
+	for (int i = 0; i < DETEX_BLOCK_CACHE_PROBE_LENGTH; i++) {
+		BlockCacheEntry *entry = &cache->entries[(key[0] + i) & mask];
+		if (entry->stamp == 0 || entry->key[0] != key[0] || entry->key[1] != key[1])
+			continue;
+		if (entry->checksum != CalculateEntryChecksum(entry))
+			break;
+		memcpy(bitstring, entry->bitstring, block_size);
+		entry->stamp = AdvanceClock(cache);
+		found = true;
+		break;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	return found;
+}
+
+void detexInsertBlockCache(detexBlockCache *cache, const uint64_t *key, const uint8_t *bitstring,
+int block_size) {
+	uint32_t mask = cache->header->nu_entries - 1;
+	pthread_mutex_lock(&cache->mutex);
+	// Use the slot that already holds the key, otherwise the first empty slot, otherwise
+	// evict the least recently used entry of the probed slots. Stamps are compared relative
+	// to the clock so that wrap-around is handled.
+	uint32_t clock = cache->header->clock;
+	BlockCacheEntry *slot = NULL;
+	uint32_t max_age = 0;
+	for (int i = 0; i < DETEX_BLOCK_CACHE_PROBE_LENGTH; i++) {
+		BlockCacheEntry *entry = &cache->entries[(key[0] + i) & mask];
+		if (entry->stamp == 0 || (entry->key[0] == key[0] && entry->key[1] == key[1])) {
+			slot = entry;
+			break;
+		}
+		uint32_t age = clock - entry->stamp;
+		if (slot == NULL || age > max_age) {
+			slot = entry;
+			max_age = age;
+		}
+	}
+	slot->key[0] = key[0];
+	slot->key[1] = key[1];
+	memset(slot->bitstring, 0, 16);
+	memcpy(slot->bitstring, bitstring, block_size);
+	slot->stamp = AdvanceClock(cache);
+	slot->checksum = CalculateEntryChecksum(slot);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
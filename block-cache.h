@@ -0,0 +1,46 @@
+/*
+
+Copyright (c) 2015 Harm Hanemaaijer <fgenfb@yahoo.com>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+*/
+
+// Persistent cache of compressed blocks. The cache is a fixed-size hash table in a
+// memory-mapped file that maps a 128-bit key, derived from the source block and all
+// settings that affect the compressed result, to the compressed block.
+
+struct detexBlockCache;
+
+// Open (or create) the cache in the given directory, which is created if it does not exist.
+// The size of the cache file is limited to max_size bytes; when the table is full, the least
+// recently used entry of the probed slots is evicted. An existing cache file that was created
+// with a different size limit or cache format is replaced by an empty one. Returns NULL on
+// failure.
+detexBlockCache *detexOpenBlockCache(const char *directory, uint64_t max_size);
+
+void detexCloseBlockCache(detexBlockCache *cache);
+
+// Calculate a 128-bit key from data, starting from the 128-bit seed (which can be a key
+// calculated earlier).
+void detexCalculateBlockCacheKey(const uint8_t *data, int size, const uint64_t *seed, uint64_t *key);
+
+// Look up the compressed block for the key. Returns true and copies the block to bitstring
+// when the key is present. The cache functions are thread-safe.
+bool detexLookupBlockCache(detexBlockCache *cache, const uint64_t *key, uint8_t *bitstring,
+	int block_size);
+
+// Store the compressed block for the key.
+void detexInsertBlockCache(detexBlockCache *cache, const uint64_t *key, const uint8_t *bitstring,
+	int block_size);
+
@@ -16,12 +16,18 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 */
 
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <float.h>
 #include <dstRandom.h>
 #ifdef __SSE2__
 #define DST_SIMD_MODE_SSE2
 #include <dstSIMD.h>
+#include <immintrin.h>
 #endif
 #include "detex.h"
+#include "compress.h"
 #include "compress-block.h"
 
 static const uint32_t detex_bc1_component_mask[6] = {
@@ -97,6 +103,372 @@ void SeedBC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng, uint8_
 		detexSetModeBC1(bitstring, info->mode, 0, NULL);
 }
 
+static DETEX_INLINE_ONLY int QuantizeComponent(double value, int max_value) {
+	int q = (int)(value * max_value / 255.0d + 0.5d);
+	if (q < 0)
+		q = 0;
+	if (q > max_value)
+		q = max_value;
+	return q;
+}
+
+// Expand a 5-bit or 6-bit component to eight bits in the same way as the decoder.
+static DETEX_INLINE_ONLY int ExpandComponent(int value, int nu_bits) {
+	if (nu_bits == 5)
+		return (value << 3) | (value >> 2);
+	return (value << 2) | (value >> 4);
+}
+
+static DETEX_INLINE_ONLY uint32_t PackColorRGB565(const double *color) {
+	return (QuantizeComponent(color[0], 31) << 11) | (QuantizeComponent(color[1], 63) << 5) |
+		QuantizeComponent(color[2], 31);
+}
+
+// Quantize the end point component value (in the 8-bit range) to nu_bits bits and return
+// the quantized value, rounded down or (with round_up) up.
+static DETEX_INLINE_ONLY int QuantizeComponentRounded(double value, int nu_bits, bool round_up) {
+	int max_value = (1 << nu_bits) - 1;
+	int q = (int)floor(value * max_value / 255.0d) + round_up;
+	if (q < 0)
+		q = 0;
+	if (q > max_value)
+		q = max_value;
+	return q;
+}
+
+// Determine the bounding box, the mean and the covariance matrix (rr, rg, rb, gg, gb, bb,
+// summed over the colors) of n colors.
+static void GetColorStatisticsBC1(const int (* DETEX_RESTRICT pixels)[3], int n, int * DETEX_RESTRICT min_color,
+int * DETEX_RESTRICT max_color, double * DETEX_RESTRICT mean, double * DETEX_RESTRICT cov) {
+	int sum[3] = { 0, 0, 0 };
+	for (int c = 0; c < 3; c++) {
+		min_color[c] = 255;
+		max_color[c] = 0;
+	}
+	for (int i = 0; i < n; i++)
+		for (int c = 0; c < 3; c++) {
+			if (pixels[i][c] < min_color[c])
+				min_color[c] = pixels[i][c];
+			if (pixels[i][c] > max_color[c])
+				max_color[c] = pixels[i][c];
+			sum[c] += pixels[i][c];
+		}
+	for (int c = 0; c < 3; c++)
+		mean[c] = (double)sum[c] / n;
+	for (int k = 0; k < 6; k++)
+		cov[k] = 0.0d;
+	for (int i = 0; i < n; i++) {
+		double r = pixels[i][0] - mean[0];
+		double g = pixels[i][1] - mean[1];
+		double b = pixels[i][2] - mean[2];
+		cov[0] += r * r;
+		cov[1] += r * g;
+		cov[2] += r * b;
+		cov[3] += g * g;
+		cov[4] += g * b;
+		cov[5] += b * b;
+	}
+}
+
+// Determine the principal axis of colors with the given covariance matrix and bounding box using
+// power iteration, starting with the bounding box diagonal.
+static void GetPrincipalAxisBC1(const double * DETEX_RESTRICT cov, const int * DETEX_RESTRICT min_color,
+const int * DETEX_RESTRICT max_color, double * DETEX_RESTRICT axis) {
+	for (int c = 0; c < 3; c++)
+		axis[c] = max_color[c] - min_color[c];
+	if (axis[0] == 0 && axis[1] == 0 && axis[2] == 0)
+		axis[0] = axis[1] = axis[2] = 1.0d;
+	for (int k = 0; k < 8; k++) {
+		double a0 = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		double a1 = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		double a2 = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		double m = fabs(a0);
+		if (fabs(a1) > m)
+			m = fabs(a1);
+		if (fabs(a2) > m)
+			m = fabs(a2);
+		if (m < 1.0e-6d)
+			break;
+		axis[0] = a0 / m;
+		axis[1] = a1 / m;
+		axis[2] = a2 / m;
+	}
+}
+
+// Weights of the first end point in the palette colors along the line from the first to the
+// second end point, in units of 1 / 6: four colors in mode 0, three in mode 1 (the fourth
+// color of mode 1 is black or transparent and not on the line).
+static const int detex_bc1_cluster_weight[2][4] = {
+	{ 6, 4, 2, 0 },
+	{ 6, 3, 0, 0 }
+};
+
+// Add cluster k (the ordered colors from start[k] to start[k + 1] - 1, with the weight w of
+// the first end point) to the sums of the clusters before it (index k) to obtain the sums up
+// to and including cluster k (index k + 1).
+static DETEX_INLINE_ONLY void AddClusterBC1(const int (* DETEX_RESTRICT sum)[3], const int * DETEX_RESTRICT start,
+int k, int w, int * DETEX_RESTRICT ww, int * DETEX_RESTRICT wv, int * DETEX_RESTRICT vv,
+int (* DETEX_RESTRICT w_sum)[3], int (* DETEX_RESTRICT v_sum)[3]) {
+	int count = start[k + 1] - start[k];
+	int v = 6 - w;
+	ww[k + 1] = ww[k] + w * w * count;
+	wv[k + 1] = wv[k] + w * v * count;
+	vv[k + 1] = vv[k] + v * v * count;
+	for (int c = 0; c < 3; c++) {
+		int s = sum[start[k + 1]][c] - sum[start[k]][c];
+		w_sum[k + 1][c] = w_sum[k][c] + w * s;
+		v_sum[k + 1][c] = v_sum[k][c] + v * s;
+	}
+}
+
+// Cluster fit of the end points in mode 0 or 1. The n colors are ordered along the principal
+// axis, and every partition of that order into consecutive clusters (one per palette color on
+// the line between the end points) is tried: the end points that minimize the error of the
+// partition are solved by least squares, quantized to 5:6:5 and the partition with the lowest
+// error for the quantized end points is kept. Its end points are then refined by trying both
+// roundings of each component, using the palette values of the decoder. Returns the color
+// pair in the format of the first 32 bits of a BC1 block.
+static uint32_t ClusterFitColorsBC1(const int (* DETEX_RESTRICT pixels)[3], int n,
+const double * DETEX_RESTRICT axis, int mode) {
+	// Sort the colors along the axis.
+	int order[16];
+	double t[16];
+	for (int i = 0; i < n; i++) {
+		double ti = pixels[i][0] * axis[0] + pixels[i][1] * axis[1] + pixels[i][2] * axis[2];
+		int j = i;
+		for (; j > 0 && t[j - 1] > ti; j--) {
+			t[j] = t[j - 1];
+			order[j] = order[j - 1];
+		}
+		t[j] = ti;
+		order[j] = i;
+	}
+	// Prefix sums of the ordered colors.
+	int sum[17][3];
+	sum[0][0] = sum[0][1] = sum[0][2] = 0;
+	for (int i = 0; i < n; i++)
+		for (int c = 0; c < 3; c++)
+			sum[i + 1][c] = sum[i][c] + pixels[order[i]][c];
+	static const int nu_bits[3] = { 5, 6, 5 };
+	const int *weight = detex_bc1_cluster_weight[mode];
+	int nu_clusters = mode == 0 ? 4 : 3;
+	// The normal equations of the least-squares fit are accumulated over the clusters, with
+	// the weights of the first (w) and second (v = 6 - w) end point scaled by 6: ww, wv and vv
+	// are the sums of the products of the weights over the colors, w_sum and v_sum the
+	// weighted sums of the colors. Cluster k covers the ordered colors from start[k] to
+	// start[k + 1] - 1; in mode 1, the (unused) fourth cluster is empty.
+	// Every partition is degenerate when there is only one color, which is then assigned to
+	// the first end point.
+	double best_error = DBL_MAX;
+	double best_endpoints[2][3];
+	int best_start[5];
+	for (int c = 0; c < 3; c++)
+		best_endpoints[0][c] = best_endpoints[1][c] = pixels[order[0]][c];
+	for (int k = 1; k < 5; k++)
+		best_start[k] = n;
+	int start[5];
+	start[0] = 0;
+	start[4] = n;
+	int ww[5], wv[5], vv[5], w_sum[5][3], v_sum[5][3];
+	ww[0] = wv[0] = vv[0] = 0;
+	for (int c = 0; c < 3; c++)
+		w_sum[0][c] = v_sum[0][c] = 0;
+	for (start[1] = 0; start[1] <= n; start[1]++) {
+		AddClusterBC1(sum, start, 0, weight[0], ww, wv, vv, w_sum, v_sum);
+		for (start[2] = start[1]; start[2] <= n; start[2]++) {
+			AddClusterBC1(sum, start, 1, weight[1], ww, wv, vv, w_sum, v_sum);
+			for (start[3] = mode == 0 ? start[2] : n; start[3] <= n; start[3]++) {
+				AddClusterBC1(sum, start, 2, weight[2], ww, wv, vv, w_sum, v_sum);
+				AddClusterBC1(sum, start, 3, weight[3], ww, wv, vv, w_sum, v_sum);
+				int det = ww[4] * vv[4] - wv[4] * wv[4];
+				if (det == 0)
+					continue;
+				double scale = 6.0d / det;
+				// The error of the least-squares end points (apart from the constant sum of
+				// the squares of the colors) is a lower bound of the error of the quantized
+				// end points.
+				double endpoints[2][3];
+				double error_bound = 0.0d;
+				for (int c = 0; c < 3; c++) {
+					endpoints[0][c] = (w_sum[4][c] * vv[4] - v_sum[4][c] * wv[4]) * scale;
+					endpoints[1][c] = (v_sum[4][c] * ww[4] - w_sum[4][c] * wv[4]) * scale;
+					error_bound -= (endpoints[0][c] * w_sum[4][c] + endpoints[1][c] * v_sum[4][c]) /
+						6.0d;
+				}
+				if (error_bound >= best_error)
+					continue;
+				double error = 0.0d;
+				for (int c = 0; c < 3; c++) {
+					double a = ExpandComponent(QuantizeComponent(endpoints[0][c],
+						(1 << nu_bits[c]) - 1), nu_bits[c]);
+					double b = ExpandComponent(QuantizeComponent(endpoints[1][c],
+						(1 << nu_bits[c]) - 1), nu_bits[c]);
+					error += (a * a * ww[4] + 2.0d * a * b * wv[4] + b * b * vv[4]) / 36.0d -
+						(a * w_sum[4][c] + b * v_sum[4][c]) / 3.0d;
+				}
+				if (error < best_error) {
+					best_error = error;
+					for (int c = 0; c < 3; c++) {
+						best_endpoints[0][c] = endpoints[0][c];
+						best_endpoints[1][c] = endpoints[1][c];
+					}
+					for (int k = 1; k < nu_clusters; k++)
+						best_start[k] = start[k];
+				}
+			}
+		}
+	}
+	best_start[0] = 0;
+	// Choose the rounding of each component of the end points. The palette values of a
+	// component only depend on the end point components, so each component is chosen
+	// separately.
+	int q[2][3];
+	for (int c = 0; c < 3; c++) {
+		uint32_t best_component_error = UINT_MAX;
+		for (int round = 0; round < 4; round++) {
+			int qa = QuantizeComponentRounded(best_endpoints[0][c], nu_bits[c], round & 1);
+			int qb = QuantizeComponentRounded(best_endpoints[1][c], nu_bits[c], round >> 1);
+			int a = ExpandComponent(qa, nu_bits[c]);
+			int b = ExpandComponent(qb, nu_bits[c]);
+			int palette[4];
+			palette[0] = a;
+			if (mode == 0) {
+				palette[1] = detexDivide0To767By3(2 * a + b);
+				palette[2] = detexDivide0To767By3(a + 2 * b);
+				palette[3] = b;
+			}
+			else {
+				palette[1] = (a + b) / 2;
+				palette[2] = b;
+			}
+			uint32_t component_error = 0;
+			for (int k = 0; k < nu_clusters; k++)
+				for (int i = best_start[k]; i < best_start[k + 1]; i++) {
+					int d = pixels[order[i]][c] - palette[k];
+					component_error += d * d;
+				}
+			if (component_error < best_component_error) {
+				best_component_error = component_error;
+				q[0][c] = qa;
+				q[1][c] = qb;
+			}
+		}
+	}
+	uint32_t color0 = (q[0][0] << 11) | (q[0][1] << 5) | q[0][2];
+	uint32_t color1 = (q[1][0] << 11) | (q[1][1] << 5) | q[1][2];
+	// The palette is symmetric in the end points, so they can be swapped to match the mode.
+	if (mode == 0 ? color0 < color1 : color0 > color1) {
+		uint32_t temp = color0;
+		color0 = color1;
+		color1 = temp;
+	}
+	return color0 | (color1 << 16);
+}
+
+// Derive candidate color pairs (in the format of the first 32 bits of a BC1 block) from the
+// pixels of the block. Pixels with an alpha value below alpha_threshold are ignored. The
+// candidates are the cluster fit of the end points (for each mode allowed by mode), the end
+// points of the principal axis of the colors (as is and inset), and the corners of the
+// bounding box. Returns the number of candidates (at most DETEX_BC1_MAX_ANALYTIC_COLORS).
+int GetAnalyticColorsBC1(const detexBlockInfo * DETEX_RESTRICT info, int mode, int alpha_threshold,
+uint32_t * DETEX_RESTRICT colors) {
+	const detexBlockPixels *block_pixels = info->pixels;
+	int pixels[16][3];
+	int n = 0;
+	for (int i = 0; i < 16; i++) {
+		if ((int)block_pixels->a[i] < alpha_threshold)
+			continue;
+		pixels[n][0] = block_pixels->r[i];
+		pixels[n][1] = block_pixels->g[i];
+		pixels[n][2] = block_pixels->b[i];
+		n++;
+	}
+	if (n == 0)
+		return 0;
+	int min_color[3];
+	int max_color[3];
+	double mean[3];
+	double cov[6];
+	if (n == 16) {
+		// All pixels count, so the statistics of the staged block apply.
+		for (int c = 0; c < 3; c++) {
+			min_color[c] = block_pixels->min_color[c];
+			max_color[c] = block_pixels->max_color[c];
+			mean[c] = block_pixels->sum[c] / 16.0d;
+		}
+		for (int k = 0; k < 6; k++)
+			cov[k] = block_pixels->covariance[k] / 16.0d;
+	}
+	else
+		GetColorStatisticsBC1(pixels, n, min_color, max_color, mean, cov);
+	double axis[3];
+	GetPrincipalAxisBC1(cov, min_color, max_color, axis);
+	uint32_t candidates[DETEX_BC1_MAX_ANALYTIC_COLORS];
+	int nu_candidates = 0;
+	for (int m = 0; m < 2; m++)
+		if (mode < 0 || m == mode) {
+			candidates[nu_candidates] = ClusterFitColorsBC1(pixels, n, axis, m);
+			nu_candidates++;
+		}
+	double norm2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	double t_min = 0.0d;
+	double t_max = 0.0d;
+	for (int i = 0; i < n; i++) {
+		double t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] +
+			(pixels[i][2] - mean[2]) * axis[2];
+		if (t < t_min)
+			t_min = t;
+		if (t > t_max)
+			t_max = t;
+	}
+	double endpoints[4][2][3];
+	for (int c = 0; c < 3; c++) {
+		// End points of the principal axis.
+		endpoints[0][0][c] = mean[c] + axis[c] * t_max / norm2;
+		endpoints[0][1][c] = mean[c] + axis[c] * t_min / norm2;
+		// The same end points, inset by 1/16th of the range.
+		double inset = (endpoints[0][0][c] - endpoints[0][1][c]) / 16.0d;
+		endpoints[1][0][c] = endpoints[0][0][c] - inset;
+		endpoints[1][1][c] = endpoints[0][1][c] + inset;
+		// Bounding box corners along the direction of the principal axis.
+		endpoints[2][0][c] = axis[c] >= 0 ? max_color[c] : min_color[c];
+		endpoints[2][1][c] = axis[c] >= 0 ? min_color[c] : max_color[c];
+		// Bounding box corners.
+		endpoints[3][0][c] = max_color[c];
+		endpoints[3][1][c] = min_color[c];
+	}
+	for (int i = 0; i < 4; i++) {
+		candidates[nu_candidates] = PackColorRGB565(endpoints[i][0]) |
+			(PackColorRGB565(endpoints[i][1]) << 16);
+		nu_candidates++;
+	}
+	int nu_colors = 0;
+	for (int i = 0; i < nu_candidates; i++) {
+		uint8_t bitstring[8];
+		*(uint32_t *)bitstring = candidates[i];
+		if (mode >= 0)
+			detexSetModeBC1(bitstring, mode, 0, NULL);
+		uint32_t c = *(uint32_t *)bitstring;
+		bool duplicate = false;
+		for (int j = 0; j < nu_colors; j++)
+			if (colors[j] == c)
+				duplicate = true;
+		if (!duplicate) {
+			colors[nu_colors] = c;
+			nu_colors++;
+		}
+	}
+	return nu_colors;
+}
+
+int AnalyticSeedBC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings) {
+	uint32_t colors[DETEX_BC1_MAX_ANALYTIC_COLORS];
+	int n = GetAnalyticColorsBC1(info, info->mode, 0, colors);
+	for (int i = 0; i < n; i++)
+		*(uint32_t *)&bitstrings[i * 16] = colors[i];
+	return n;
+}
+
 void MutateBC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng, int generation,
 uint8_t * DETEX_RESTRICT bitstring) {
 	uint32_t *bitstring32 = (uint32_t *)bitstring;
@@ -163,101 +535,11 @@ uint8_t * DETEX_RESTRICT bitstring) {
 
 static DETEX_INLINE_ONLY uint32_t SetPixelXYBC1(const uint8_t * DETEX_RESTRICT pix_orig, int stride_orig, int dx, int dy,
 const int * DETEX_RESTRICT color_r, const int * DETEX_RESTRICT color_g, const int * DETEX_RESTRICT color_b,
-uint32_t & DETEX_RESTRICT pixel_indices) {
+uint32_t ignored_pixel_mask, uint32_t & DETEX_RESTRICT pixel_indices) {
 	uint32_t pixel_orig = *(uint32_t *)(pix_orig + dy * stride_orig + dx * 4);
 	int r_orig = detexPixel32GetR8(pixel_orig);
 	int g_orig = detexPixel32GetG8(pixel_orig);
 	int b_orig = detexPixel32GetB8(pixel_orig);
-#ifdef __SSE2__
-	__simd128_int m_color_orig_r = simd128_set_same_int32(r_orig);
-	__simd128_int m_color_orig_g = simd128_set_same_int32(g_orig);
-	__simd128_int m_color_orig_b = simd128_set_same_int32(b_orig);
-	__simd128_int m_color_r = simd128_load_int(color_r);
-	__simd128_int m_color_g = simd128_load_int(color_g);
-	__simd128_int m_color_b = simd128_load_int(color_b);
-	__simd128_int m_diff_r = simd128_sub_int32(m_color_orig_r, m_color_r);
-	__simd128_int m_diff_g = simd128_sub_int32(m_color_orig_g, m_color_g);
-	__simd128_int m_diff_b = simd128_sub_int32(m_color_orig_b, m_color_b);
-#ifdef __SSE41__
-	__simd128_int m_sqr_diff_r = _mm_mullo_epi32(m_diff_r, m_diff_r);
-	__simd128_int m_sqr_diff_g = _mm_mullo_epi32(m_diff_g, m_diff_g);
-	__simd128_int m_sqr_diff_b = _mm_mullo_epi32(m_diff_b, m_diff_b);
-#else
-	__simd128_int low_int16_mask = simd128_set_same_int32(0x0000FFFF);
-	__simd128_int m_sqr_diff_r = simd128_and_int(
-		_mm_mullo_epi16(m_diff_r, m_diff_r),
-		low_int16_mask);
-	__simd128_int m_sqr_diff_g = simd128_and_int(
-		_mm_mullo_epi16(m_diff_g, m_diff_g),
-		low_int16_mask);
-	__simd128_int m_sqr_diff_b = simd128_and_int(
-		_mm_mullo_epi16(m_diff_b, m_diff_b),
-		low_int16_mask);
-#endif
-	__simd128_int m_error_pixel0123 = simd128_add_int32(m_sqr_diff_r,
-		simd128_add_int32(m_sqr_diff_g, m_sqr_diff_b));
-#if 0
-	__simd128_int m_best_error = m_error_pixel0123;
-	__simd128_int m_best_pixel_index = simd128_set_zero_int();
-	// Compare error1 with error0
-	__simd128_int m_error = simd128_shift_right_bytes_int(m_error_pixel0123, 4);
-	__simd128_int m_cmp = _mm_cmplt_epi32(m_error, m_best_error);
-	m_best_pixel_index = simd128_or_int(
-		m_best_pixel_index,
-		simd128_and_int(
-			simd128_set_same_int32(1), m_cmp)
-		);
-	m_best_error = simd128_or_int(
-		simd128_andnot_int(m_cmp, m_best_error),
-		simd128_and_int(m_cmp, m_error));
-	// Compare error2
-	m_error = simd128_shift_right_bytes_int(m_error_pixel0123, 8);
-	m_cmp = _mm_cmplt_epi32(m_error, m_best_error);
-	m_best_pixel_index = simd128_or_int(
-		simd128_andnot_int(
-			m_cmp, m_best_pixel_index),
-		simd128_and_int(
-			m_cmp, simd128_set_same_int32(2))
-		);
-	m_best_error = simd128_or_int(
-		simd128_andnot_int(m_cmp, m_best_error),
-		simd128_and_int(m_cmp, m_error));
-	// Compare error3
-	m_error = simd128_shift_right_bytes_int(m_error_pixel0123, 12);
-	m_cmp = _mm_cmplt_epi32(m_error, m_best_error);
-	m_best_pixel_index = simd128_or_int(
-		simd128_andnot_int(
-			m_cmp, m_best_pixel_index),
-		simd128_and_int(
-			m_cmp, simd128_set_same_int32(3))
-		);
-	m_best_error = simd128_or_int(
-		simd128_andnot_int(m_cmp, m_best_error),
-		simd128_and_int(m_cmp, m_error));
-	uint32_t best_pixel_index = simd128_get_int32(m_best_pixel_index);
-	uint32_t best_error = simd128_get_int32(m_best_error);
-//	printf("best_pixel_index = %d, best_error = 0x%08X\n", best_pixel_index, best_error);
-#else
-	uint32_t best_error = simd128_get_int32(m_error_pixel0123);
-	uint32_t error1 = simd128_get_int32(simd128_shift_right_bytes_int(m_error_pixel0123, 4));
-	uint32_t error2 = simd128_get_int32(simd128_shift_right_bytes_int(m_error_pixel0123, 8));
-	uint32_t error3 = simd128_get_int32(simd128_shift_right_bytes_int(m_error_pixel0123, 12));
-// printf("Error0/1/2/3: 0x%08X, 0x%08X, 0x%08X, 0x%08X\n", best_error, error1, error2, error3);
-	int best_pixel_index = 0;
-	if (error1 < best_error) {
-		best_error = error1;
-		best_pixel_index = 1;
-	}
-	if (error2 < best_error) {
-		best_error = error2;
-		best_pixel_index = 2;
-	}
-	if (error3 < best_error) {
-		best_error = error3;
-		best_pixel_index = 3;
-	}
-#endif
-#else
 	uint32_t best_error = GetPixelErrorRGB8(r_orig, g_orig, b_orig, color_r[0], color_g[0], color_b[0]);
 	int best_pixel_index = 0;
 	uint32_t error1 = GetPixelErrorRGB8(r_orig, g_orig, b_orig, color_r[1], color_g[1], color_b[1]);
@@ -275,20 +557,21 @@ uint32_t & DETEX_RESTRICT pixel_indices) {
 		best_error = error3;
 		best_pixel_index = 3;
 	}
-#endif
 	int i = dy * 4 + dx;
 	pixel_indices |= best_pixel_index << (i * 2);
+	if (ignored_pixel_mask & (1 << i))
+		return 0;
 	return best_error;
 }
 
 static DETEX_INLINE_ONLY void DecodeColorsBC1(uint32_t colors, int * DETEX_RESTRICT color_r,
 int * DETEX_RESTRICT color_g, int * DETEX_RESTRICT color_b) {
-	color_b[0] = (colors & 0x0000001F) << 3;
-	color_g[0] = (colors & 0x000007E0) >> (5 - 2);
-	color_r[0] = (colors & 0x0000F800) >> (11 - 3);
-	color_b[1] = (colors & 0x001F0000) >> (16 - 3);
-	color_g[1] = (colors & 0x07E00000) >> (21 - 2);
-	color_r[1] = (colors & 0xF8000000) >> (27 - 3);
+	color_b[0] = ExpandComponent(colors & 0x0000001F, 5);
+	color_g[0] = ExpandComponent((colors & 0x000007E0) >> 5, 6);
+	color_r[0] = ExpandComponent((colors & 0x0000F800) >> 11, 5);
+	color_b[1] = ExpandComponent((colors & 0x001F0000) >> 16, 5);
+	color_g[1] = ExpandComponent((colors & 0x07E00000) >> 21, 6);
+	color_r[1] = ExpandComponent((colors & 0xF8000000) >> 27, 5);
 	if ((colors & 0xFFFF) > ((colors & 0xFFFF0000) >> 16)) {
 		color_r[2] = detexDivide0To767By3(2 * color_r[0] + color_r[1]);
 		color_g[2] = detexDivide0To767By3(2 * color_g[0] + color_g[1]);
@@ -305,9 +588,142 @@ int * DETEX_RESTRICT color_g, int * DETEX_RESTRICT color_b) {
 	}
 }
 
+#ifdef __SSE2__
+
+// Pixel-parallel kernel for SetPixelsBC1() and SetPixelsBC1A(). The components of the 16
+// pixels of the block are held as 16-bit values (eight pixels per register), and each palette
+// color is compared with all pixels at once; the squared differences are summed with
+// _mm_madd_epi16() into 32-bit errors (four pixels per register). The lowest error and its
+// index are selected with compares and masks, and the 2-bit pixel indices are packed without
+// leaving the SIMD registers. When color_a is NULL, alpha is ignored (BC1); otherwise alpha is
+// included in the error and pixels that are transparent in both the original block and the
+// palette color have zero error (BC1A).
+static DETEX_INLINE_ONLY uint32_t SetPixelsSIMDBC1(const detexBlockInfo * DETEX_RESTRICT info,
+const int * DETEX_RESTRICT color_r, const int * DETEX_RESTRICT color_g, const int * DETEX_RESTRICT color_b,
+const int * DETEX_RESTRICT color_a, uint32_t bound, uint32_t & DETEX_RESTRICT pixel_indices) {
+	const detexBlockPixels *pixels = info->pixels;
+	__simd128_int m_zero = simd128_set_zero_int();
+	// Rows 0-1 and rows 2-3 of the block, one component per register.
+	__simd128_int m_r[2], m_g[2], m_b[2], m_a[2];
+	__simd128_int m_pixels_r = _mm_load_si128((const __m128i *)pixels->r);
+	__simd128_int m_pixels_g = _mm_load_si128((const __m128i *)pixels->g);
+	__simd128_int m_pixels_b = _mm_load_si128((const __m128i *)pixels->b);
+	m_r[0] = _mm_unpacklo_epi8(m_pixels_r, m_zero);
+	m_r[1] = _mm_unpackhi_epi8(m_pixels_r, m_zero);
+	m_g[0] = _mm_unpacklo_epi8(m_pixels_g, m_zero);
+	m_g[1] = _mm_unpackhi_epi8(m_pixels_g, m_zero);
+	m_b[0] = _mm_unpacklo_epi8(m_pixels_b, m_zero);
+	m_b[1] = _mm_unpackhi_epi8(m_pixels_b, m_zero);
+	// For BC1A, the masks of the pixels of each row that are fully transparent.
+	__simd128_int m_transparent[4];
+	if (color_a != NULL) {
+		__simd128_int m_pixels_a = _mm_load_si128((const __m128i *)pixels->a);
+		m_a[0] = _mm_unpacklo_epi8(m_pixels_a, m_zero);
+		m_a[1] = _mm_unpackhi_epi8(m_pixels_a, m_zero);
+		for (int row = 0; row < 4; row++) {
+			__simd128_int m_row_a = row & 1 ? _mm_unpackhi_epi16(m_a[row >> 1], m_zero) :
+				_mm_unpacklo_epi16(m_a[row >> 1], m_zero);
+			m_transparent[row] = _mm_cmpeq_epi32(m_row_a, m_zero);
+		}
+	}
+	else {
+		m_a[0] = m_zero;
+		m_a[1] = m_zero;
+	}
+	__simd128_int m_color_r[4], m_color_g[4], m_color_b[4], m_color_a[4];
+	for (int k = 0; k < 4; k++) {
+		m_color_r[k] = _mm_set1_epi16(color_r[k]);
+		m_color_g[k] = _mm_set1_epi16(color_g[k]);
+		m_color_b[k] = _mm_set1_epi16(color_b[k]);
+		m_color_a[k] = _mm_set1_epi16(color_a != NULL ? color_a[k] : 0);
+	}
+	__simd128_int m_best_error[4];
+	__simd128_int m_best_pixel_index[4];
+	// Rows 0-1 are evaluated first, so that the evaluation can stop when their error already
+	// reaches the bound.
+	for (int j = 0; j < 2; j++) {
+		for (int k = 0; k < 4; k++) {
+			__simd128_int m_pixel_index = simd128_set_same_int32(k);
+			__simd128_int m_diff_r = _mm_sub_epi16(m_r[j], m_color_r[k]);
+			__simd128_int m_diff_g = _mm_sub_epi16(m_g[j], m_color_g[k]);
+			__simd128_int m_diff_b = _mm_sub_epi16(m_b[j], m_color_b[k]);
+			__simd128_int m_diff_a = _mm_sub_epi16(m_a[j], m_color_a[k]);
+			__simd128_int m_diff_rg = _mm_unpacklo_epi16(m_diff_r, m_diff_g);
+			__simd128_int m_diff_ba = _mm_unpacklo_epi16(m_diff_b, m_diff_a);
+			__simd128_int m_error[2];
+			m_error[0] = simd128_add_int32(_mm_madd_epi16(m_diff_rg, m_diff_rg),
+				_mm_madd_epi16(m_diff_ba, m_diff_ba));
+			m_diff_rg = _mm_unpackhi_epi16(m_diff_r, m_diff_g);
+			m_diff_ba = _mm_unpackhi_epi16(m_diff_b, m_diff_a);
+			m_error[1] = simd128_add_int32(_mm_madd_epi16(m_diff_rg, m_diff_rg),
+				_mm_madd_epi16(m_diff_ba, m_diff_ba));
+			for (int l = 0; l < 2; l++) {
+				int row = j * 2 + l;
+				if (color_a != NULL && color_a[k] == 0)
+					m_error[l] = simd128_andnot_int(m_transparent[row], m_error[l]);
+				if (k == 0) {
+					m_best_error[row] = m_error[l];
+					m_best_pixel_index[row] = m_zero;
+					continue;
+				}
+				// Like the scalar version, keep the first color with the lowest error.
+				__simd128_int m_cmp = _mm_cmplt_epi32(m_error[l], m_best_error[row]);
+				m_best_error[row] = simd128_or_int(
+					simd128_andnot_int(m_cmp, m_best_error[row]),
+					simd128_and_int(m_cmp, m_error[l]));
+				m_best_pixel_index[row] = simd128_or_int(
+					simd128_andnot_int(m_cmp, m_best_pixel_index[row]),
+					simd128_and_int(m_cmp, m_pixel_index));
+			}
+		}
+		// The pixels of info->ignored_pixel_mask add no error.
+		if (info->ignored_pixel_mask != 0)
+			for (int l = 0; l < 2; l++) {
+				int row = j * 2 + l;
+				uint32_t row_mask = info->ignored_pixel_mask >> (row * 4);
+				m_best_error[row] = simd128_andnot_int(_mm_set_epi32(
+					- (int)((row_mask >> 3) & 1), - (int)((row_mask >> 2) & 1),
+					- (int)((row_mask >> 1) & 1), - (int)(row_mask & 1)), m_best_error[row]);
+			}
+		if (j == 0) {
+			__simd128_int m_error = simd128_add_int32(m_best_error[0], m_best_error[1]);
+			m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0x4E));
+			m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0xB1));
+			uint32_t error = simd128_get_int32(m_error);
+			if (error >= bound) {
+				pixel_indices = 0;
+				return error;
+			}
+		}
+	}
+	// Sum the errors of all pixels.
+	__simd128_int m_error = simd128_add_int32(
+		simd128_add_int32(m_best_error[0], m_best_error[1]),
+		simd128_add_int32(m_best_error[2], m_best_error[3]));
+	m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0x4E));
+	m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0xB1));
+	// Pack the pixel indices: first into 16-bit lanes (one pixel each), then combine pairs of
+	// pixels into 4-bit values and pairs of those into 8-bit values (one row each), and
+	// finally pack the rows into the four bytes of the low 32 bits.
+	__simd128_int m_indices01 = _mm_packs_epi32(m_best_pixel_index[0], m_best_pixel_index[1]);
+	__simd128_int m_indices23 = _mm_packs_epi32(m_best_pixel_index[2], m_best_pixel_index[3]);
+	__simd128_int m_shift2 = _mm_set1_epi32(0x00040001);
+	__simd128_int m_shift4 = _mm_set1_epi32(0x00100001);
+	__simd128_int m_indices = _mm_packs_epi32(_mm_madd_epi16(m_indices01, m_shift2),
+		_mm_madd_epi16(m_indices23, m_shift2));
+	m_indices = _mm_madd_epi16(m_indices, m_shift4);
+	m_indices = _mm_packs_epi32(m_indices, m_indices);
+	m_indices = _mm_packus_epi16(m_indices, m_indices);
+	pixel_indices = simd128_get_int32(m_indices);
+	return simd128_get_int32(m_error);
+}
+
+#endif
+
 // Set the pixel indices of the compressed block using the available colors so that they
 // most closely match the original block. Return the comparison error value.
-uint32_t SetPixelsBC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+uint32_t SetPixelsBC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring,
+uint32_t bound) {
 	// Decode colors.
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || !defined(__BYTE_ORDER__)
 	uint32_t colors = *(uint32_t *)&bitstring[0];
@@ -317,36 +733,382 @@ uint32_t SetPixelsBC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETE
 		((uint32_t)bitstring[2] << 8) | bitstring[3];
 #endif
 	// Decode the two 5-6-5 RGB colors.
-	int color_r[4] DST_ALIGNED(16), color_g[4] DST_ALIGNED(16), color_b[4] DST_ALIGNED(16);
+	int color_r[4], color_g[4], color_b[4];
 	DecodeColorsBC1(colors, color_r, color_g, color_b);
 	// Set pixels indices.
+	uint32_t pixel_indices;
+#ifdef __SSE2__
+	uint32_t error = SetPixelsSIMDBC1(info, color_r, color_g, color_b, NULL, bound, pixel_indices);
+#else
 	const detexTexture *texture = info->texture;
 	int x = info->x;
 	int y = info->y;
 	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 4;
 	int stride_orig = texture->width * 4;
-	uint32_t pixel_indices = 0;
+	uint32_t mask = info->ignored_pixel_mask;
+	pixel_indices = 0;
 	uint32_t error = 0;
-	error += SetPixelXYBC1(pix_orig, stride_orig, 0, 0, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 1, 0, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 2, 0, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 3, 0, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 0, 1, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 1, 1, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 2, 1, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 3, 1, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 0, 2, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 1, 2, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 2, 2, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 3, 2, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 0, 3, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 1, 3, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 2, 3, color_r, color_g, color_b, pixel_indices);
-	error += SetPixelXYBC1(pix_orig, stride_orig, 3, 3, color_r, color_g, color_b, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 0, 0, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 1, 0, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 2, 0, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 3, 0, color_r, color_g, color_b, mask, pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYBC1(pix_orig, stride_orig, 0, 1, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 1, 1, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 2, 1, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 3, 1, color_r, color_g, color_b, mask, pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYBC1(pix_orig, stride_orig, 0, 2, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 1, 2, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 2, 2, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 3, 2, color_r, color_g, color_b, mask, pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYBC1(pix_orig, stride_orig, 0, 3, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 1, 3, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 2, 3, color_r, color_g, color_b, mask, pixel_indices);
+	error += SetPixelXYBC1(pix_orig, stride_orig, 3, 3, color_r, color_g, color_b, mask, pixel_indices);
+#endif
 	*(uint32_t *)(bitstring + 4) = pixel_indices;
 	return error;
 }
 
+// Set the pixel indices of DETEX_BATCH_SIZE (four) candidate bitstrings, 16 bytes apart, and
+// store their comparison error values. Each candidate occupies one 32-bit lane, so that each
+// pixel of the original block is only loaded once for the whole batch.
+void SetPixelsBatchBC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings,
+uint32_t bound, uint32_t * DETEX_RESTRICT errors) {
+#ifdef __SSE2__
+	// Decode the colors of the candidates into SoA layout: element k * 4 + i holds the
+	// component of color k of candidate i.
+	int palette_r[16] DST_ALIGNED(16), palette_g[16] DST_ALIGNED(16), palette_b[16] DST_ALIGNED(16);
+	for (int i = 0; i < 4; i++) {
+		int color_r[4], color_g[4], color_b[4];
+		DecodeColorsBC1(*(uint32_t *)&bitstrings[i * 16], color_r, color_g, color_b);
+		for (int k = 0; k < 4; k++) {
+			palette_r[k * 4 + i] = color_r[k];
+			palette_g[k * 4 + i] = color_g[k];
+			palette_b[k * 4 + i] = color_b[k];
+		}
+	}
+	__simd128_int m_palette_r[4], m_palette_g[4], m_palette_b[4];
+	for (int k = 0; k < 4; k++) {
+		m_palette_r[k] = simd128_load_int(&palette_r[k * 4]);
+		m_palette_g[k] = simd128_load_int(&palette_g[k * 4]);
+		m_palette_b[k] = simd128_load_int(&palette_b[k * 4]);
+	}
+	const detexBlockPixels *pixels = info->pixels;
+	__simd128_int low_int16_mask = simd128_set_same_int32(0x0000FFFF);
+	// The errors are far below INT_MAX, so the signed comparison with the bound is exact.
+	__simd128_int m_bound = simd128_set_same_int32(bound > INT_MAX ? INT_MAX : bound);
+	__simd128_int m_error = simd128_set_zero_int();
+	__simd128_int m_pixel_indices = simd128_set_zero_int();
+	for (int i = 0; i < 16; i++) {
+		__simd128_int m_color_orig_r = simd128_set_same_int32(pixels->r[i]);
+		__simd128_int m_color_orig_g = simd128_set_same_int32(pixels->g[i]);
+		__simd128_int m_color_orig_b = simd128_set_same_int32(pixels->b[i]);
+		__simd128_int m_best_error;
+		__simd128_int m_best_pixel_index = simd128_set_zero_int();
+		for (int k = 0; k < 4; k++) {
+			// The differences are in the range -255 to 255, so the squares fit in the
+			// low 16 bits of each lane.
+			__simd128_int m_diff_r = simd128_sub_int32(m_color_orig_r, m_palette_r[k]);
+			__simd128_int m_diff_g = simd128_sub_int32(m_color_orig_g, m_palette_g[k]);
+			__simd128_int m_diff_b = simd128_sub_int32(m_color_orig_b, m_palette_b[k]);
+			__simd128_int m_pixel_error = simd128_add_int32(
+				simd128_and_int(_mm_mullo_epi16(m_diff_r, m_diff_r), low_int16_mask),
+				simd128_add_int32(
+				simd128_and_int(_mm_mullo_epi16(m_diff_g, m_diff_g), low_int16_mask),
+				simd128_and_int(_mm_mullo_epi16(m_diff_b, m_diff_b), low_int16_mask)));
+			if (k == 0) {
+				m_best_error = m_pixel_error;
+				continue;
+			}
+			// Like the scalar version, keep the first color with the lowest error.
+			__simd128_int m_cmp = _mm_cmplt_epi32(m_pixel_error, m_best_error);
+			m_best_error = simd128_or_int(
+				simd128_andnot_int(m_cmp, m_best_error),
+				simd128_and_int(m_cmp, m_pixel_error));
+			m_best_pixel_index = simd128_or_int(
+				simd128_andnot_int(m_cmp, m_best_pixel_index),
+				simd128_and_int(m_cmp, simd128_set_same_int32(k)));
+		}
+		// The pixels of info->ignored_pixel_mask add no error.
+		if (info->ignored_pixel_mask & (1 << i))
+			m_best_error = simd128_set_zero_int();
+		m_error = simd128_add_int32(m_error, m_best_error);
+		m_pixel_indices = simd128_or_int(m_pixel_indices,
+			_mm_sll_epi32(m_best_pixel_index, _mm_cvtsi32_si128(i * 2)));
+		// After each row, stop when the error of every candidate has reached the bound.
+		if ((i & 3) == 3 && i < 15 &&
+		_mm_movemask_epi8(_mm_cmplt_epi32(m_error, m_bound)) == 0) {
+			_mm_storeu_si128((__m128i *)errors, m_error);
+			return;
+		}
+	}
+	uint32_t pixel_indices[4];
+	_mm_storeu_si128((__m128i *)errors, m_error);
+	_mm_storeu_si128((__m128i *)pixel_indices, m_pixel_indices);
+	for (int i = 0; i < 4; i++)
+		*(uint32_t *)(bitstrings + i * 16 + 4) = pixel_indices[i];
+#else
+	for (int i = 0; i < DETEX_BATCH_SIZE; i++)
+		errors[i] = SetPixelsBC1(info, &bitstrings[i * 16], bound);
+#endif
+}
+
+double CompressBlockBC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlockBatched <uint32_t, 8, AnalyticSeedBC1, SeedBC1, MutateBC1,
+		SetPixelsBatchBC1>(info, rng, bitstring, params);
+}
+
+double CompressBlockAnalyticBC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlockAnalytic <uint32_t, 8, AnalyticSeedBC1, SetPixelsBC1>(info, rng, bitstring,
+		params);
+}
+
+#ifdef DETEX_AVX2_KERNELS
+
+// AVX2 version of SetPixelsBatchBC1(). The low and high halves of each register hold the four
+// candidates for pixel i and pixel i + 8 of the block, so that the pixels are processed two
+// at a time; the halves are combined at the end.
+DETEX_TARGET_AVX2 void SetPixelsBatchBC1AVX2(const detexBlockInfo * DETEX_RESTRICT info,
+uint8_t * DETEX_RESTRICT bitstrings, uint32_t bound, uint32_t * DETEX_RESTRICT errors) {
+	int palette_r[16] DST_ALIGNED(16), palette_g[16] DST_ALIGNED(16), palette_b[16] DST_ALIGNED(16);
+	for (int i = 0; i < 4; i++) {
+		int color_r[4], color_g[4], color_b[4];
+		DecodeColorsBC1(*(uint32_t *)&bitstrings[i * 16], color_r, color_g, color_b);
+		for (int k = 0; k < 4; k++) {
+			palette_r[k * 4 + i] = color_r[k];
+			palette_g[k * 4 + i] = color_g[k];
+			palette_b[k * 4 + i] = color_b[k];
+		}
+	}
+	__m256i m_palette_r[4], m_palette_g[4], m_palette_b[4];
+	for (int k = 0; k < 4; k++) {
+		__m128i m_r = _mm_load_si128((const __m128i *)&palette_r[k * 4]);
+		__m128i m_g = _mm_load_si128((const __m128i *)&palette_g[k * 4]);
+		__m128i m_b = _mm_load_si128((const __m128i *)&palette_b[k * 4]);
+		m_palette_r[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(m_r), m_r, 1);
+		m_palette_g[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(m_g), m_g, 1);
+		m_palette_b[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(m_b), m_b, 1);
+	}
+	const detexBlockPixels *pixels = info->pixels;
+	__m256i m_low_int16_mask = _mm256_set1_epi32(0x0000FFFF);
+	__m128i m_bound = _mm_set1_epi32(bound > INT_MAX ? INT_MAX : bound);
+	__m256i m_error = _mm256_setzero_si256();
+	__m256i m_pixel_indices = _mm256_setzero_si256();
+	for (int i = 0; i < 8; i++) {
+		int r0 = pixels->r[i];
+		int g0 = pixels->g[i];
+		int b0 = pixels->b[i];
+		int r1 = pixels->r[i + 8];
+		int g1 = pixels->g[i + 8];
+		int b1 = pixels->b[i + 8];
+		__m256i m_color_orig_r = _mm256_setr_epi32(r0, r0, r0, r0, r1, r1, r1, r1);
+		__m256i m_color_orig_g = _mm256_setr_epi32(g0, g0, g0, g0, g1, g1, g1, g1);
+		__m256i m_color_orig_b = _mm256_setr_epi32(b0, b0, b0, b0, b1, b1, b1, b1);
+		__m256i m_best_error;
+		__m256i m_best_pixel_index = _mm256_setzero_si256();
+		for (int k = 0; k < 4; k++) {
+			__m256i m_diff_r = _mm256_sub_epi32(m_color_orig_r, m_palette_r[k]);
+			__m256i m_diff_g = _mm256_sub_epi32(m_color_orig_g, m_palette_g[k]);
+			__m256i m_diff_b = _mm256_sub_epi32(m_color_orig_b, m_palette_b[k]);
+			__m256i m_pixel_error = _mm256_add_epi32(
+				_mm256_and_si256(_mm256_mullo_epi16(m_diff_r, m_diff_r), m_low_int16_mask),
+				_mm256_add_epi32(
+				_mm256_and_si256(_mm256_mullo_epi16(m_diff_g, m_diff_g), m_low_int16_mask),
+				_mm256_and_si256(_mm256_mullo_epi16(m_diff_b, m_diff_b), m_low_int16_mask)));
+			if (k == 0) {
+				m_best_error = m_pixel_error;
+				continue;
+			}
+			// Like the scalar version, keep the first color with the lowest error.
+			__m256i m_cmp = _mm256_cmpgt_epi32(m_best_error, m_pixel_error);
+			m_best_error = _mm256_min_epi32(m_best_error, m_pixel_error);
+			m_best_pixel_index = _mm256_blendv_epi8(m_best_pixel_index, _mm256_set1_epi32(k), m_cmp);
+		}
+		// The pixels of info->ignored_pixel_mask add no error.
+		if (info->ignored_pixel_mask & (0x101 << i)) {
+			int ignored0 = - (int)((info->ignored_pixel_mask >> i) & 1);
+			int ignored1 = - (int)((info->ignored_pixel_mask >> (i + 8)) & 1);
+			m_best_error = _mm256_andnot_si256(_mm256_setr_epi32(ignored0, ignored0, ignored0,
+				ignored0, ignored1, ignored1, ignored1, ignored1), m_best_error);
+		}
+		m_error = _mm256_add_epi32(m_error, m_best_error);
+		m_pixel_indices = _mm256_or_si256(m_pixel_indices, _mm256_sllv_epi32(m_best_pixel_index,
+			_mm256_setr_epi32(i * 2, i * 2, i * 2, i * 2, i * 2 + 16, i * 2 + 16, i * 2 + 16, i * 2 + 16)));
+		// After rows 0 and 2, stop when the error of every candidate has reached the bound.
+		if (i == 3) {
+			__m128i m_partial_error = _mm_add_epi32(_mm256_castsi256_si128(m_error),
+				_mm256_extracti128_si256(m_error, 1));
+			if (_mm_movemask_epi8(_mm_cmplt_epi32(m_partial_error, m_bound)) == 0) {
+				_mm_storeu_si128((__m128i *)errors, m_partial_error);
+				return;
+			}
+		}
+	}
+	_mm_storeu_si128((__m128i *)errors, _mm_add_epi32(_mm256_castsi256_si128(m_error),
+		_mm256_extracti128_si256(m_error, 1)));
+	uint32_t pixel_indices[4];
+	_mm_storeu_si128((__m128i *)pixel_indices, _mm_or_si128(_mm256_castsi256_si128(m_pixel_indices),
+		_mm256_extracti128_si256(m_pixel_indices, 1)));
+	for (int i = 0; i < 4; i++)
+		*(uint32_t *)(bitstrings + i * 16 + 4) = pixel_indices[i];
+}
+
+double CompressBlockBC1AVX2(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlockBatched <uint32_t, 8, AnalyticSeedBC1, SeedBC1, MutateBC1,
+		SetPixelsBatchBC1AVX2>(info, rng, bitstring, params);
+}
+
+#endif
+
+// Optimal end points for a single color component value, for the interpolated color at
+// 2/3 of the way between the end points (four-color mode) and for the midpoint (three-color
+// mode), together with the remaining error.
+struct SingleColorEntryBC1 {
+	uint8_t color0;
+	uint8_t color1;
+	uint8_t error;
+};
+
+// Indexed by 5-bit/6-bit component, four-color/three-color mode and component value.
+static SingleColorEntryBC1 detex_bc1_single_color_table[2][2][256];
+
+static bool InitializeSingleColorTableBC1() {
+	for (int k = 0; k < 2; k++) {
+		int nu_bits = k == 0 ? 5 : 6;
+		int max_value = (1 << nu_bits) - 1;
+		for (int m = 0; m < 2; m++)
+			for (int v = 0; v < 256; v++) {
+				int best_score = INT_MAX;
+				for (int c0 = 0; c0 <= max_value; c0++)
+					for (int c1 = 0; c1 <= max_value; c1++) {
+						int e0 = ExpandComponent(c0, nu_bits);
+						int e1 = ExpandComponent(c1, nu_bits);
+						int value;
+						if (m == 0)
+							value = detexDivide0To767By3(2 * e0 + e1);
+						else
+							value = (e0 + e1) / 2;
+						int error = abs(value - v);
+						// Prefer end points that are close together.
+						int score = error * 1024 + abs(e0 - e1);
+						if (score < best_score) {
+							best_score = score;
+							detex_bc1_single_color_table[k][m][v].color0 = c0;
+							detex_bc1_single_color_table[k][m][v].color1 = c1;
+							detex_bc1_single_color_table[k][m][v].error = error;
+						}
+					}
+			}
+	}
+	return true;
+}
+
+// Set the end points for a single color using the single color tables, using four-color mode
+// (mode 0), three-color mode (mode 1) or whichever is better (mode -1). Returns the pixel
+// index that represents the color.
+static int EncodeSingleColorBC1(uint32_t color, int mode, uint8_t * DETEX_RESTRICT bitstring) {
+	static bool table_initialized = InitializeSingleColorTableBC1();
+	(void)table_initialized;
+	int r = detexPixel32GetR8(color);
+	int g = detexPixel32GetG8(color);
+	int b = detexPixel32GetB8(color);
+	const SingleColorEntryBC1 *entry[2][3];
+	uint32_t error[2];
+	for (int m = 0; m < 2; m++) {
+		entry[m][0] = &detex_bc1_single_color_table[0][m][r];
+		entry[m][1] = &detex_bc1_single_color_table[1][m][g];
+		entry[m][2] = &detex_bc1_single_color_table[0][m][b];
+		error[m] = entry[m][0]->error * entry[m][0]->error + entry[m][1]->error * entry[m][1]->error +
+			entry[m][2]->error * entry[m][2]->error;
+	}
+	int m = mode;
+	if (mode < 0)
+		m = error[1] < error[0] ? 1 : 0;
+	uint32_t color0 = (entry[m][0]->color0 << 11) | (entry[m][1]->color0 << 5) | entry[m][2]->color0;
+	uint32_t color1 = (entry[m][0]->color1 << 11) | (entry[m][1]->color1 << 5) | entry[m][2]->color1;
+	int pixel_index;
+	if (m == 0) {
+		// Four-color mode requires color0 > color1. When the end points are swapped, the
+		// color at 2/3 of the way is represented by pixel index 3 instead of 2.
+		if (color0 > color1)
+			pixel_index = 2;
+		else if (color0 < color1) {
+			uint32_t temp = color0;
+			color0 = color1;
+			color1 = temp;
+			pixel_index = 3;
+		}
+		else
+			pixel_index = 0;
+	}
+	else {
+		// Three-color mode requires color0 <= color1.
+		if (color0 > color1) {
+			uint32_t temp = color0;
+			color0 = color1;
+			color1 = temp;
+		}
+		pixel_index = 2;
+	}
+	*(uint32_t *)bitstring = color0 | (color1 << 16);
+	return pixel_index;
+}
+
+static DETEX_INLINE_ONLY bool ColorIsExactRGB565(uint32_t color, uint32_t & DETEX_RESTRICT color565) {
+	int r = detexPixel32GetR8(color) >> 3;
+	int g = detexPixel32GetG8(color) >> 2;
+	int b = detexPixel32GetB8(color) >> 3;
+	color565 = (r << 11) | (g << 5) | b;
+	return ExpandComponent(r, 5) == (int)detexPixel32GetR8(color) &&
+		ExpandComponent(g, 6) == (int)detexPixel32GetG8(color) &&
+		ExpandComponent(b, 5) == (int)detexPixel32GetB8(color);
+}
+
+// Directly encode the color part of a block that consists of a single color, or of two
+// colors that are exactly representable as end points, using the colors determined by
+// SetBlockFlags. For a single color, mode selects the BC1 mode like EncodeSingleColorBC1.
+// Returns false if the block is not such a block.
+bool EncodeTrivialColorsBC1(const detexBlockInfo * DETEX_RESTRICT info, int mode,
+uint8_t * DETEX_RESTRICT bitstring) {
+	if ((info->flags & DETEX_BLOCK_FLAG_MAX_TWO_COLORS) == 0)
+		return false;
+	if (info->colors[0] == info->colors[1]) {
+		int pixel_index = EncodeSingleColorBC1(info->colors[0], mode, bitstring);
+		*(uint32_t *)(bitstring + 4) = pixel_index * 0x55555555;
+		return true;
+	}
+	uint32_t color0, color1;
+	if (!ColorIsExactRGB565(info->colors[0], color0) || !ColorIsExactRGB565(info->colors[1], color1))
+		return false;
+	// Use pixel indices 0 and 1, which represent the end points in both modes.
+	const detexTexture *texture = info->texture;
+	const uint8_t *pix_orig = texture->data + (info->y * texture->width + info->x) * 4;
+	int stride_orig = texture->width * 4;
+	uint32_t pixel_indices = 0;
+	for (int dy = 0; dy < 4; dy++)
+		for (int dx = 0; dx < 4; dx++) {
+			uint32_t pixel = *(uint32_t *)(pix_orig + dy * stride_orig + dx * 4);
+			if ((pixel & 0xFFFFFF) != info->colors[0])
+				pixel_indices |= 1 << ((dy * 4 + dx) * 2);
+		}
+	*(uint32_t *)bitstring = color0 | (color1 << 16);
+	*(uint32_t *)(bitstring + 4) = pixel_indices;
+	return true;
+}
+
+bool EncodeTrivialBC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+	return EncodeTrivialColorsBC1(info, - 1, bitstring);
+}
+
 static const int detex_BC1A_modes_1[] = { 1, -1 };
 static const int detex_BC1A_modes_01[] = { 0, 1, -1 };
 
@@ -357,14 +1119,58 @@ const int *GetModesBC1A(const detexBlockInfo *info) {
 	return detex_BC1A_modes_01;
 }
 
+int AnalyticSeedBC1A(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings) {
+	// Pixels with alpha below 128 will be mapped to the transparent color (mode 1).
+	uint32_t colors[DETEX_BC1_MAX_ANALYTIC_COLORS];
+	int n = GetAnalyticColorsBC1(info, info->mode, 128, colors);
+	for (int i = 0; i < n; i++)
+		*(uint32_t *)&bitstrings[i * 16] = colors[i];
+	return n;
+}
+
+bool EncodeTrivialBC1A(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+	if (info->flags & DETEX_BLOCK_FLAG_OPAQUE)
+		return EncodeTrivialColorsBC1(info, - 1, bitstring);
+	if ((info->flags & DETEX_BLOCK_FLAG_PUNCHTHROUGH) == 0)
+		return false;
+	// Punchthrough block: use three-color mode when all opaque pixels have the same color,
+	// with pixel index 3 for the transparent pixels.
+	const detexTexture *texture = info->texture;
+	const uint8_t *pix_orig = texture->data + (info->y * texture->width + info->x) * 4;
+	int stride_orig = texture->width * 4;
+	uint32_t transparent_mask = 0;
+	int color = - 1;
+	for (int dy = 0; dy < 4; dy++)
+		for (int dx = 0; dx < 4; dx++) {
+			uint32_t pixel = *(uint32_t *)(pix_orig + dy * stride_orig + dx * 4);
+			if (detexPixel32GetA8(pixel) == 0) {
+				transparent_mask |= 3 << ((dy * 4 + dx) * 2);
+				continue;
+			}
+			if (color == - 1)
+				color = pixel & 0xFFFFFF;
+			else if ((int)(pixel & 0xFFFFFF) != color)
+				return false;
+		}
+	if (color == - 1) {
+		// Fully transparent block.
+		*(uint32_t *)bitstring = 0;
+		*(uint32_t *)(bitstring + 4) = 0xFFFFFFFF;
+		return true;
+	}
+	int pixel_index = EncodeSingleColorBC1(color, 1, bitstring);
+	*(uint32_t *)(bitstring + 4) = ((pixel_index * 0x55555555) & ~transparent_mask) | transparent_mask;
+	return true;
+}
+
 static DETEX_INLINE_ONLY void DecodeColorsBC1A(uint32_t colors, int * DETEX_RESTRICT color_r,
 int * DETEX_RESTRICT color_g, int * DETEX_RESTRICT color_b, int * DETEX_RESTRICT color_a) {
-	color_b[0] = (colors & 0x0000001F) << 3;
-	color_g[0] = (colors & 0x000007E0) >> (5 - 2);
-	color_r[0] = (colors & 0x0000F800) >> (11 - 3);
-	color_b[1] = (colors & 0x001F0000) >> (16 - 3);
-	color_g[1] = (colors & 0x07E00000) >> (21 - 2);
-	color_r[1] = (colors & 0xF8000000) >> (27 - 3);
+	color_b[0] = ExpandComponent(colors & 0x0000001F, 5);
+	color_g[0] = ExpandComponent((colors & 0x000007E0) >> 5, 6);
+	color_r[0] = ExpandComponent((colors & 0x0000F800) >> 11, 5);
+	color_b[1] = ExpandComponent((colors & 0x001F0000) >> 16, 5);
+	color_g[1] = ExpandComponent((colors & 0x07E00000) >> 21, 6);
+	color_r[1] = ExpandComponent((colors & 0xF8000000) >> 27, 5);
 	color_a[0] = color_a[1] = color_a[2] = 0xFF;
 	if ((colors & 0xFFFF) > ((colors & 0xFFFF0000) >> 16)) {
 		color_r[2] = detexDivide0To767By3(2 * color_r[0] + color_r[1]);
@@ -420,7 +1226,8 @@ const int * DETEX_RESTRICT color_a, uint32_t & DETEX_RESTRICT pixel_indices) {
 
 // Set the pixel indices of the compressed block using the available colors so that they
 // most closely match the original block. Return the comparison error value.
-uint32_t SetPixelsBC1A(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+uint32_t SetPixelsBC1A(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring,
+uint32_t bound) {
 	// Decode colors.
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || !defined(__BYTE_ORDER__)
 	uint32_t colors = *(uint32_t *)&bitstring[0];
@@ -433,30 +1240,53 @@ uint32_t SetPixelsBC1A(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DET
 	int color_r[4], color_g[4], color_b[4], color_a[4];
 	DecodeColorsBC1A(colors, color_r, color_g, color_b, color_a);
 	// Set pixels indices.
+	uint32_t pixel_indices;
+#ifdef __SSE2__
+	uint32_t error = SetPixelsSIMDBC1(info, color_r, color_g, color_b, color_a, bound, pixel_indices);
+#else
 	const detexTexture *texture = info->texture;
 	int x = info->x;
 	int y = info->y;
 	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 4;
 	int stride_orig = texture->width * 4;
-	uint32_t pixel_indices = 0;
+	pixel_indices = 0;
 	uint32_t error = 0;
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 0, 0, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 1, 0, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 2, 0, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 3, 0, color_r, color_g, color_b, color_a, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 0, 1, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 1, 1, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 2, 1, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 3, 1, color_r, color_g, color_b, color_a, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 0, 2, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 1, 2, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 2, 2, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 3, 2, color_r, color_g, color_b, color_a, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 0, 3, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 1, 3, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 2, 3, color_r, color_g, color_b, color_a, pixel_indices);
 	error += SetPixelXYBC1A(pix_orig, stride_orig, 3, 3, color_r, color_g, color_b, color_a, pixel_indices);
+#endif
 	*(uint32_t *)(bitstring + 4) = pixel_indices;
 	return error;
 }
 
+double CompressBlockBC1A(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlock <uint32_t, 8, AnalyticSeedBC1A, SeedBC1, MutateBC1,
+		SetPixelsBC1A>(info, rng, bitstring, params);
+}
+
+double CompressBlockAnalyticBC1A(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlockAnalytic <uint32_t, 8, AnalyticSeedBC1A, SetPixelsBC1A>(info, rng, bitstring,
+		params);
+}
+
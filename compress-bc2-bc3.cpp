@@ -16,160 +16,149 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 */
 
+#include <limits.h>
+#include <float.h>
+#include <math.h>
 #include <dstRandom.h>
 #include "detex.h"
+#include "compress.h"
 #include "compress-block.h"
 
-static void SetAlphaPixelsBC2(const detexTexture * DETEX_RESTRICT texture, int x, int y,
-uint8_t * DETEX_RESTRICT bitstring) {
-	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 4;
-	int stride_orig = texture->width * 4;
+// Return the mask (bit i for pixel i) of the pixels that are fully transparent in both the
+// original block and the decoded alpha values alpha; the color of these pixels does not
+// contribute to the error.
+static uint32_t GetIgnoredPixelMaskBC2BC3(const detexBlockInfo * DETEX_RESTRICT info,
+const int * DETEX_RESTRICT alpha) {
+	const detexBlockPixels *pixels = info->pixels;
+	uint32_t mask = 0;
+	for (int i = 0; i < 16; i++)
+		if ((pixels->a[i] | alpha[i]) == 0)
+			mask |= 1 << i;
+	return mask;
+}
+
+int AnalyticSeedColorsBC2BC3(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings) {
+	// The colors of fully transparent pixels do not matter.
+	uint32_t colors[DETEX_BC1_MAX_ANALYTIC_COLORS];
+	int n = GetAnalyticColorsBC1(info, 0, 1, colors);
+	for (int i = 0; i < n; i++)
+		*(uint32_t *)&bitstrings[i * 16] = colors[i];
+	return n;
+}
+
+// Search the colors of a BC2 or BC3 block (the last eight bytes of bitstring) for the alpha
+// values already set in the first eight bytes, given their decoded values and error. The
+// alpha error does not depend on the colors, and the colors only depend on the alpha values
+// through the pixels that are fully transparent in both the original block and the encoded
+// alpha, so the colors are searched with the BC1 kernels without decompressing the block.
+// Returns the block RMSE.
+template <void (*SetPixelsBatch)(const detexBlockInfo *info, uint8_t *bitstrings, uint32_t bound,
+	uint32_t *errors)>
+static double CompressColorsBC2BC3(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const int * DETEX_RESTRICT alpha, uint32_t alpha_error,
+const detexCompressionParameters * DETEX_RESTRICT params) {
+	detexBlockInfo color_info = *info;
+	// The colors are always decoded in four-color mode.
+	color_info.mode = 0;
+	color_info.ignored_pixel_mask = GetIgnoredPixelMaskBC2BC3(info, alpha);
+	// The colors get the part of the target error that is left after the alpha error.
+	detexCompressionParameters color_params = *params;
+	double target_error = params->target_rmse * params->target_rmse * 16.0d - alpha_error;
+	color_params.target_rmse = target_error > 0 ? sqrt(target_error / 16.0d) : 0;
+	if (params->flags & DETEX_COMPRESS_FLAG_ANALYTIC)
+		detexCompressBlockAnalytic <uint32_t, 8, AnalyticSeedColorsBC2BC3, SetPixelsBC1>(&color_info, rng,
+			bitstring + 8, &color_params);
+	else
+		detexCompressBlockBatched <uint32_t, 8, AnalyticSeedColorsBC2BC3, SeedBC1, MutateBC1,
+			SetPixelsBatch>(&color_info, rng, bitstring + 8, &color_params);
+	uint32_t color_error = SetPixelsBC1(&color_info, bitstring + 8, detexErrorLimits <uint32_t>::Max());
+	return sqrt((double)(alpha_error + color_error) / 16.0d);
+}
+
+// Set the explicit alpha values of a BC2 block, which are optimal on their own. Returns the
+// alpha error and stores the decoded alpha values in alpha.
+static uint32_t SetAlphaPixelsBC2(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring,
+int * DETEX_RESTRICT alpha) {
+	const detexBlockPixels *pixels = info->pixels;
 	uint64_t alpha_pixels = 0;
-	for (y = 0; y < 4;  y++)
-		for (int x = 0; x < 4; x++) {
-			uint32_t alpha_value = pix_orig[y * stride_orig + x * 4 + 3];
-			// Scale and round the alpha value to the values allowed by BC2.
-			uint32_t alpha_pixel = (alpha_value * 15 + 8) / 255;
-			int i = y * 4 + x;
-			alpha_pixels |= (uint64_t)alpha_pixel << (i * 4);
-		}
+	uint32_t error = 0;
+	for (int i = 0; i < 16; i++) {
+		int alpha_value = pixels->a[i];
+		// Round the alpha value to the nearest of the values allowed by BC2 (multiples of 17).
+		int alpha_pixel = (alpha_value + 8) / 17;
+		alpha_pixels |= (uint64_t)alpha_pixel << (i * 4);
+		alpha[i] = alpha_pixel * 17;
+		error += (alpha_value - alpha[i]) * (alpha_value - alpha[i]);
+	}
 	*(uint64_t *)&bitstring[0] = alpha_pixels;
+	return error;
 }
 
-void SeedBC2(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng,
+// Encode the color part of a BC2 or BC3 block directly when all pixels are fully transparent
+// (in which case the colors do not matter) or when the colors are trivial.
+static bool EncodeTrivialColorsBC2BC3(const detexBlockInfo * DETEX_RESTRICT info,
 uint8_t * DETEX_RESTRICT bitstring) {
-	// Only seed the color values.
-	uint32_t color_values = rng->Random32();
-	uint32_t *color_values_p32 = (uint32_t *)(bitstring + 8);
-	*(uint32_t *)color_values_p32 = color_values;
-	// Ensure the colors correspond to mode 0 of BC1.
-	detexSetModeBC1(bitstring + 8, 0, 0, NULL);
-	SetAlphaPixelsBC2(info->texture, info->x, info->y, bitstring);
+	if ((info->flags & (DETEX_BLOCK_FLAG_TRANSPARENT | DETEX_BLOCK_FLAG_PUNCHTHROUGH)) ==
+	(DETEX_BLOCK_FLAG_TRANSPARENT | DETEX_BLOCK_FLAG_PUNCHTHROUGH)) {
+		*(uint64_t *)bitstring = 0;
+		return true;
+	}
+	// The colors are always decoded in four-color mode.
+	return EncodeTrivialColorsBC1(info, 0, bitstring);
 }
 
-void MutateBC2(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng, int generation,
-uint8_t * DETEX_RESTRICT bitstring) {
-	// Since mode is always 0 for BC2, the correct BC1 color mode (0) will be passed.
-	MutateBC1(info, rng, generation, bitstring + 8);
+bool EncodeTrivialBC2(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+	// Rounding each alpha value to the nearest value that BC2 can represent is optimal on its
+	// own, so the block is trivial when the colors are.
+	if (!EncodeTrivialColorsBC2BC3(info, bitstring + 8))
+		return false;
+	int alpha[16];
+	SetAlphaPixelsBC2(info, bitstring, alpha);
+	return true;
 }
 
-uint32_t SetPixelsBC2(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
-	return SetPixelsBC1(info, bitstring + 8);
+// The explicit alpha values are set once, after which only the colors are searched.
+double CompressBlockBC2(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	int alpha[16];
+	uint32_t alpha_error = SetAlphaPixelsBC2(info, bitstring, alpha);
+	return CompressColorsBC2BC3 <SetPixelsBatchBC1>(info, rng, bitstring, alpha, alpha_error, params);
 }
 
-void SeedBC3(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng,
-uint8_t * DETEX_RESTRICT bitstring) {
-	// Only seed the color and alpha values.
-	uint32_t color_values = rng->Random32();
-	uint32_t *color_values_p32 = (uint32_t *)(bitstring + 8);
-	*(uint32_t *)color_values_p32 = color_values;
-	uint32_t alpha_values = rng->RandomBits(16);
-	// Ensure the colors correspond to mode 0 of BC1.
-	detexSetModeBC1(bitstring + 8, 0, 0, NULL);
-	// Set the mode for BC3.
-	if (info->mode >= 0) {
-		int m = (alpha_values & 0xFF) <= (alpha_values >> 8);
-		if (m != info->mode)
-			alpha_values = ((alpha_values & 0xFF) << 8) | (alpha_values >> 8);
-	}
-	*(uint16_t *)(bitstring) = alpha_values;
-}
-
-static const uint32_t detex_bc3_component_mask[6] = {
-	0xFF, 0xFF00
-};
-
-static const uint8_t detex_bc3_component_shift[6] = {
-	0, 8
-};
-
-static const int8_t detex_bc3_mutation_table1[8][3] = {
-	{ 0, -1, 0 },	// alpha0
-	{ 0, -1, 0 },	// alpha0
-	{ 0, -1, 0 },	// alpha0
-	{ 1, -1, 0 },	// alpha1
-	{ 1, -1, 0 },	// alpha1
-	{ 1, -1, 0 },	// alpha1
-	{ 0, 1, -1 },	// alpha0, alpha1
-	{ 0, 1, -1 },	// alpha0, alpha1
-};
-
-static const uint8_t detex_bc3_offset_random_bits_table[] = {
-	6, 6, 6, 6, 6, 6, 6, 6,	// Random 1 to 64, generation 128-1023 (unused)
-	6,			// Random 1 to 64, generation 1024-1151
-	5,			// Random 1 to 32, generation 1152-1280
-	4,			// Random 1 to 16, generation 1280-1407
-	3,			// Random 1 to 8, generation 1408-1535
-	2, 2,			// Random 1 to 4, generation 1536 to 1791
-	1, 1			// Random 1 to 2, generation 1792 to 2047
-};
-
-void MutateBC3(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng, int generation,
-uint8_t * DETEX_RESTRICT bitstring) {
-	detexBlockInfo info2 = *info;
-	info2.mode = 0;
-	MutateBC1(&info2, rng, generation, bitstring + 8);
-	// Mutate alpha base values.
-	uint16_t *bitstring16 = (uint16_t *)bitstring;
-	uint32_t alpha_values = *bitstring16;
-	if (generation < 1024) {
-		// For generations < 1024, replace components entirely with a random
-		// value.
-		for (;;) {
-			int mutation_type = rng->RandomBits(3);
-			const int8_t *mutationp = detex_bc3_mutation_table1[mutation_type];
-			for (;*mutationp >= 0; mutationp++) {
-				int component = *mutationp;
-				uint32_t mask = detex_bc3_component_mask[component];
-				// Set the component to a random value.
-				int value = rng->RandomBits(8);
-				alpha_values &= ~mask;
-				alpha_values |= value << detex_bc3_component_shift[component];
-			}
-			int m = (alpha_values & 0xFF) <= (alpha_values >> 8);
-			if (info->mode < 0 || m == info->mode)
-				break;
-		}
-		*(uint16_t *)bitstring16 = alpha_values;
-		return;
-	}
-	// For generations >= 1024, apply diminishing random offset to components.
-	int generation_table_index = generation / 128;
-	if (generation_table_index > 15)
-		generation_table_index = 15;
-	for (;;) {
-		int mutation_type = rng->RandomBits(3);
-		const int8_t *mutationp = detex_bc3_mutation_table1[mutation_type];
-		for (;*mutationp >= 0; mutationp++) {
-			int component = *mutationp;
-			uint32_t mask = detex_bc3_component_mask[component];
-			int value = (alpha_values & mask) >> detex_bc3_component_shift[component];
-			int offset;
-			int sign_bit;
-			int offset_random_bits = detex_bc3_offset_random_bits_table[generation_table_index];
-			int rnd = rng->RandomBits(offset_random_bits + 1);
-			sign_bit = rnd & 1;
-			offset = (rnd >> 1) + 1;
-			// Apply positive or negative displacement.
-			if (sign_bit == 0) {
-				value += offset;
-				if (value > 0xFF)
-					value = 0xFF;
-			}
-			else {
-				value -= offset;
-				if (value < 0)
-					value = 0;
-			}
-			alpha_values &= ~mask;
-			alpha_values |= value << detex_bc3_component_shift[component];
-		}
-		int m = (alpha_values & 0xFF) <= (alpha_values >> 8);
-		if (info->mode < 0 || m == info->mode)
-			break;
-	}
-	*(uint16_t *)bitstring16 = alpha_values;
+#ifdef DETEX_AVX2_KERNELS
 
+double CompressBlockBC2AVX2(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	int alpha[16];
+	uint32_t alpha_error = SetAlphaPixelsBC2(info, bitstring, alpha);
+	return CompressColorsBC2BC3 <SetPixelsBatchBC1AVX2>(info, rng, bitstring, alpha, alpha_error,
+		params);
+}
+
+#endif
+
+static void GetAlphaValuesBC3(const detexBlockInfo * DETEX_RESTRICT info, int * DETEX_RESTRICT alpha) {
+	const detexBlockPixels *pixels = info->pixels;
+	for (int i = 0; i < 16; i++)
+		alpha[i] = pixels->a[i];
+}
+
+int AnalyticSeedAlphaBC3(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings) {
+	int alpha[16];
+	GetAlphaValuesBC3(info, alpha);
+	uint32_t alpha_values[4];
+	int n = GetAnalyticValuesRGTC1(alpha, info->mode, alpha_values);
+	for (int i = 0; i < n; i++)
+		*(uint16_t *)&bitstrings[i * 16] = alpha_values[i];
+	return n;
+}
+
+bool EncodeTrivialBC3(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+	int alpha[16];
+	GetAlphaValuesBC3(info, alpha);
+	if (!EncodeExactValuesRGTC1(alpha, bitstring))
+		return false;
+	return EncodeTrivialColorsBC2BC3(info, bitstring + 8);
 }
 
 static DETEX_INLINE_ONLY uint32_t SetAlphaPixelXYBC3(const uint8_t * DETEX_RESTRICT pix_orig, int stride_orig,
@@ -209,40 +198,101 @@ static DETEX_INLINE_ONLY void DecodeAlphaBC3(int *alpha) {
 	}
 }
 
-uint32_t SetPixelsBC3(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+// Set the alpha pixel indices of a BC3 block (the first eight bytes of bitstring) and return
+// the alpha error.
+uint32_t SetAlphaPixelsBC3(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring,
+uint32_t bound) {
 	const detexTexture *texture = info->texture;
-	int x = info->x;
-	int y = info->y;
-	uint32_t error = SetPixelsBC1(info, bitstring + 8);
 	int alpha[8];
 	alpha[0] = bitstring[0];
 	alpha[1] = bitstring[1];
 	DecodeAlphaBC3(alpha);
-	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 4;
+	uint8_t *pix_orig = texture->data + (info->y * texture->width + info->x) * 4;
 	int stride_orig = texture->width * 4;
 	uint64_t alpha_pixel_indices = 0;
-	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 0, 0, alpha, alpha_pixel_indices);
+#ifdef __SSE2__
+	// All pixels are evaluated at once, so the bound is not used.
+	uint32_t error = SetPixelIndicesSIMD8Levels(pix_orig, stride_orig, 4, 3, alpha, alpha_pixel_indices);
+#else
+	uint32_t error = SetAlphaPixelXYBC3(pix_orig, stride_orig, 0, 0, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 1, 0, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 2, 0, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 3, 0, alpha, alpha_pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 0, 1, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 1, 1, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 2, 1, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 3, 1, alpha, alpha_pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 0, 2, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 1, 2, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 2, 2, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 3, 2, alpha, alpha_pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 0, 3, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 1, 3, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 2, 3, alpha, alpha_pixel_indices);
 	error += SetAlphaPixelXYBC3(pix_orig, stride_orig, 3, 3, alpha, alpha_pixel_indices);
+#endif
 	*(uint64_t *)bitstring = *(uint16_t *)bitstring | (alpha_pixel_indices << 16);
-	// Recalculate error because alpha values influence color error result (when both alpha
-	// values are zero, the color values are disregarded).
-	uint8_t pixel_buffer[64];
-	detexDecompressBlockBC3(bitstring, 0x3, 0, pixel_buffer);
-	error = detexCalculateErrorRGBA8(texture, x, y, pixel_buffer);
 	return error;
 }
 
+// Search the alpha values of a BC3 block on their own, in the same way as an RGTC1 block (the
+// alpha part of a BC3 block has the same layout). Returns the alpha error and stores the
+// decoded alpha values in alpha.
+static uint32_t CompressAlphaBC3(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, int * DETEX_RESTRICT alpha,
+const detexCompressionParameters * DETEX_RESTRICT params) {
+	uint32_t error;
+	if (params->flags & DETEX_COMPRESS_FLAG_ANALYTIC) {
+		int values[16];
+		GetAlphaValuesBC3(info, values);
+		error = CompressValuesAnalyticRGTC1(values, info->mode, bitstring);
+	}
+	else if (params->flags & DETEX_COMPRESS_FLAG_EXHAUSTIVE) {
+		int values[16];
+		GetAlphaValuesBC3(info, values);
+		error = CompressValuesExhaustiveRGTC1(values, info->mode, bitstring);
+	}
+	else {
+		// The search is not stopped at the target error, so that the part of it that is
+		// left after the alpha error goes to the colors.
+		detexCompressionParameters alpha_params = *params;
+		alpha_params.target_rmse = 0;
+		detexCompressBlock <uint32_t, 8, AnalyticSeedAlphaBC3, SeedRGTC1, MutateRGTC1,
+			SetAlphaPixelsBC3>(info, rng, bitstring, &alpha_params);
+		error = SetAlphaPixelsBC3(info, bitstring, detexErrorLimits <uint32_t>::Max());
+	}
+	int palette[8];
+	palette[0] = bitstring[0];
+	palette[1] = bitstring[1];
+	DecodeAlphaBC3(palette);
+	uint64_t alpha_pixel_indices = *(uint64_t *)bitstring >> 16;
+	for (int i = 0; i < 16; i++)
+		alpha[i] = palette[(alpha_pixel_indices >> (i * 3)) & 0x7];
+	return error;
+}
+
+// The alpha values are searched first, after which the colors are searched for them.
+double CompressBlockBC3(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	int alpha[16];
+	uint32_t alpha_error = CompressAlphaBC3(info, rng, bitstring, alpha, params);
+	return CompressColorsBC2BC3 <SetPixelsBatchBC1>(info, rng, bitstring, alpha, alpha_error, params);
+}
+
+#ifdef DETEX_AVX2_KERNELS
+
+double CompressBlockBC3AVX2(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	int alpha[16];
+	uint32_t alpha_error = CompressAlphaBC3(info, rng, bitstring, alpha, params);
+	return CompressColorsBC2BC3 <SetPixelsBatchBC1AVX2>(info, rng, bitstring, alpha, alpha_error,
+		params);
+}
+
+#endif
@@ -30,44 +30,258 @@ enum {
 };
 
 
+// Pixels of an RGBA8 or RGBX8 block, staged before the block is compressed in a contiguous,
+// aligned buffer with one array per component (pixel i is at dx = i % 4, dy = i / 4), so that
+// the kernels load them with aligned, unit-stride loads instead of gathering and unpacking
+// them from the texture for every candidate. The statistics are those of the RGB components
+// of all 16 pixels.
+struct detexBlockPixels {
+	uint8_t r[16] __attribute__ ((aligned (16)));
+	uint8_t g[16];
+	uint8_t b[16];
+	uint8_t a[16];
+	int min_color[3];
+	int max_color[3];
+	// Sum of each component (16 times the mean).
+	int sum[3];
+	// Covariance matrix (rr, rg, rb, gg, gb, bb), multiplied by 256.
+	int covariance[6];
+};
+
 struct detexBlockInfo {
 	const detexTexture * DETEX_RESTRICT texture;
+	// Staged pixels of the block for RGBA8 and RGBX8 textures, NULL for other pixel formats.
+	const detexBlockPixels * DETEX_RESTRICT pixels;
 	int x;
 	int y;
 	int mode;
 	uint32_t flags;
 	uint32_t DETEX_RESTRICT colors[2];
+	// Pixel size of the texture and the component that is compressed. The one-component
+	// formats (RGTC1 and SIGNED_RGTC1) read the component directly from the texture, so
+	// that the components of RGTC2 and SIGNED_RGTC2 are compressed in place.
+	int pixel_size;
+	int component;
+	// Pixels (bit i for pixel i) whose color does not contribute to the error, so that the
+	// color search of BC2 and BC3 can disregard the pixels that are fully transparent in both
+	// the original block and the encoded alpha values. Zero for other formats.
+	uint32_t ignored_pixel_mask;
 };
 
+// Maximum number of candidates returned by an analytic seeding function.
+#define DETEX_MAX_ANALYTIC_SEEDS 8
+
 enum detexErrorUnit {
 	DETEX_ERROR_UNIT_UINT32,
 	DETEX_ERROR_UNIT_UINT64,
 	DETEX_ERROR_UNIT_DOUBLE
 };
 
-typedef uint32_t (*detexSetPixelsFunc)(const detexBlockInfo *block_info, uint8_t *bitstring);
 typedef uint32_t (*detexCalculateErrorFunc)(const detexTexture *texture, int x, int y, uint8_t *pixel_buffer);
 
+// Search for the best encoding of a block in the mode of block_info, write it to bitstring and
+// return the block RMSE.
+typedef double (*detexCompressBlockFunc)(const detexBlockInfo *block_info, dstCMWCRNG *rng,
+	uint8_t *bitstring, const detexCompressionParameters *params);
+
+// AVX2 kernels are compiled with a target attribute, so that they are available without
+// changing the compiler flags, and are only used when params->isa selects them (see
+// detexGetBestISA()).
+#if defined(__SSE2__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DETEX_AVX2_KERNELS
+#define DETEX_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#endif
+
 struct detexCompressionInfo {
 	int nu_modes;
 	bool modal_default;
 	const int *(*get_modes_func)(const detexBlockInfo *block_info);
 	detexErrorUnit error_unit;
-	void (*seed_func)(const detexBlockInfo *block_info, dstCMWCRNG *rng, uint8_t *bitstring);
+	// Instantiation of detexCompressBlock() for the format, for each instruction set
+	// (DETEX_ISA_*). Formats without kernels for an instruction set use the baseline function.
+	detexCompressBlockFunc compress_block_func[DETEX_NU_ISAS];
+	// Directly encode trivial blocks (such as solid color blocks) for which the encoding
+	// produced is optimal. Returns false when the block is not trivial.
+	bool (*encode_trivial_func)(const detexBlockInfo *block_info, uint8_t *bitstring);
 	void (*set_mode_func)(uint8_t *bitstring, uint32_t mode, uint32_t flags, uint32_t *colors);
-	void (*mutate_func)(const detexBlockInfo *block_info, dstCMWCRNG *rng, int generation, uint8_t *bitstring);
-	union {
-		uint32_t (*set_pixels_error_uint32_func)(const detexBlockInfo *block_info, uint8_t *bitstring);
-		uint64_t (*set_pixels_error_uint64_func)(const detexBlockInfo *block_info, uint8_t *bitstring);
-		double (*set_pixels_error_double_func)(const detexBlockInfo *block_info, uint8_t *bitstring);
-	};
 	union {
 		uint32_t (*calculate_error_uint32_func)(const detexTexture *texture, int x, int y, uint8_t *pixel_buffer);
 		uint64_t (*calculate_error_uint64_func)(const detexTexture *texture, int x, int y, uint8_t *pixel_buffer);
 		double (*calculate_error_double_func)(const detexTexture *texture, int x, int y, uint8_t *pixel_buffer);
 	};
+	// Optional search for the optimal encoding of a block in the given mode (or in all modes
+	// for mode -1), used instead of compress_block_func with DETEX_COMPRESS_FLAG_EXHAUSTIVE.
+	// The result does not depend on the random number generator, so one try suffices.
+	detexCompressBlockFunc compress_block_exhaustive_func;
+	// Optional direct encoding of a block without a search in the given mode (or in all modes
+	// for mode -1), used instead of the other functions with DETEX_COMPRESS_FLAG_ANALYTIC.
+	// Formats that combine encodings (BC2 and BC3) leave it NULL; their compress_block_func
+	// checks the flag for each part.
+	detexCompressBlockFunc compress_block_analytic_func;
+};
+
+template <class ErrorType> struct detexErrorLimits;
+
+template <> struct detexErrorLimits <uint32_t> {
+	static uint32_t Max() { return UINT_MAX; }
+};
+
+template <> struct detexErrorLimits <uint64_t> {
+	static uint64_t Max() { return UINT64_MAX; }
 };
 
+template <> struct detexErrorLimits <double> {
+	static double Max() { return DBL_MAX; }
+};
+
+// The SetPixels functions of a format set the pixel indices of a candidate encoding and return
+// its comparison error. They are given a bound (the best error so far, or the maximum value
+// of the error type for a full evaluation) and may stop once the partial error of the pixels
+// evaluated so far reaches it; they then return that partial error (at least bound) and the
+// pixel indices are incomplete, which is harmless because the candidate is rejected. The
+// batched variants stop once all candidates of the batch have reached the bound.
+
+// Number of candidates evaluated at once by the batched block search.
+#define DETEX_BATCH_SIZE 4
+
+// Produce the candidate for the given generation of the block search: the analytic seeds
+// (candidates derived from the pixels of the block) first, then random seeds, and after that
+// a mutation of the best encoding so far (bitstring_best), following the schedule in params.
+template <int block_size,
+void (*Seed)(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring),
+void (*Mutate)(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring)>
+static DETEX_INLINE_ONLY void detexGetCandidate(const detexBlockInfo * DETEX_RESTRICT block_info,
+dstCMWCRNG *rng, int generation, const uint8_t * DETEX_RESTRICT analytic_bitstrings,
+int nu_analytic_seeds, const uint8_t * DETEX_RESTRICT bitstring_best,
+const detexCompressionParameters * DETEX_RESTRICT params, uint8_t * DETEX_RESTRICT bitstring) {
+	if (generation < nu_analytic_seeds) {
+		// Start with the analytic seeds.
+		memcpy(bitstring, &analytic_bitstrings[generation * 16], block_size);
+	}
+	else if (generation < params->nu_seed_generations) {
+		// For the first iterations, use the seeding function.
+		Seed(block_info, rng, bitstring);
+	}
+	else {
+		// After that, use mutation. The mutation functions are tuned for the default
+		// schedule (mutation from generation 256 to 2047), so map the generation onto
+		// that range.
+		int mutation_generation = 256 + (generation - params->nu_seed_generations) *
+			(2048 - 256) / (params->nu_generations - params->nu_seed_generations);
+		if (mutation_generation > 2047)
+			mutation_generation = 2047;
+		memcpy(bitstring, bitstring_best, block_size);
+		Mutate(block_info, rng, mutation_generation, bitstring);
+	}
+}
+
+// Genetic search for the best encoding of a block (see detexGetCandidate()). The functions
+// of the format are template arguments, and each format instantiates the template in its own
+// module (see CompressBlockBC1() etc.), so that the seeding, mutation and error calculation
+// are resolved at compile time and can be inlined into the loop.
+template <class ErrorType, int block_size,
+int (*AnalyticSeed)(const detexBlockInfo *info, uint8_t *bitstrings),
+void (*Seed)(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring),
+void (*Mutate)(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring),
+ErrorType (*SetPixels)(const detexBlockInfo *info, uint8_t *bitstring, ErrorType bound)>
+double detexCompressBlock(const detexBlockInfo * DETEX_RESTRICT block_info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring_out, const detexCompressionParameters * DETEX_RESTRICT params) {
+	uint8_t bitstring[16];
+	uint8_t analytic_bitstrings[DETEX_MAX_ANALYTIC_SEEDS * 16];
+	int nu_analytic_seeds = AnalyticSeed(block_info, analytic_bitstrings);
+	// The error is the sum of squared differences over the 16 pixels of the block.
+	ErrorType best_error = detexErrorLimits <ErrorType>::Max();
+	double target_error = params->target_rmse * params->target_rmse * 16.0d;
+	int nu_generations = params->nu_generations;
+	int nu_stale_generations = params->nu_stale_generations;
+	int last_improvement_generation = -1;
+	for (int generation = 0; generation < nu_generations ||
+	last_improvement_generation > generation - nu_stale_generations;) {
+		detexGetCandidate <block_size, Seed, Mutate>(block_info, rng, generation,
+			analytic_bitstrings, nu_analytic_seeds, bitstring_out, params, bitstring);
+		// Candidates are only accepted when they improve on the best error, so the
+		// evaluation can stop as soon as the error reaches it.
+		ErrorType error = SetPixels(block_info, bitstring, best_error);
+		if (error < best_error) {
+			best_error = error;
+			memcpy(bitstring_out, bitstring, block_size);
+			last_improvement_generation = generation;
+		}
+		generation++;
+		// Stop when the target quality has been reached (with a target of zero, only when
+		// the block is lossless).
+		if ((double)best_error <= target_error)
+			break;
+	}
+	return sqrt((double)best_error / 16.0d);
+}
+
+// Batched variant of detexCompressBlock(). Each step produces DETEX_BATCH_SIZE candidates
+// (mutations of the same best encoding), which SetPixelsBatch evaluates together with SIMD
+// across the candidates (the candidate bitstrings are 16 bytes apart); the best candidate
+// of the batch is accepted.
+template <class ErrorType, int block_size,
+int (*AnalyticSeed)(const detexBlockInfo *info, uint8_t *bitstrings),
+void (*Seed)(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring),
+void (*Mutate)(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring),
+void (*SetPixelsBatch)(const detexBlockInfo *info, uint8_t *bitstrings, ErrorType bound,
+	ErrorType *errors)>
+double detexCompressBlockBatched(const detexBlockInfo * DETEX_RESTRICT block_info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring_out, const detexCompressionParameters * DETEX_RESTRICT params) {
+	uint8_t bitstrings[DETEX_BATCH_SIZE * 16];
+	ErrorType errors[DETEX_BATCH_SIZE];
+	uint8_t analytic_bitstrings[DETEX_MAX_ANALYTIC_SEEDS * 16];
+	int nu_analytic_seeds = AnalyticSeed(block_info, analytic_bitstrings);
+	ErrorType best_error = detexErrorLimits <ErrorType>::Max();
+	double target_error = params->target_rmse * params->target_rmse * 16.0d;
+	int nu_generations = params->nu_generations;
+	int nu_stale_generations = params->nu_stale_generations;
+	int last_improvement_generation = -1;
+	for (int generation = 0; generation < nu_generations ||
+	last_improvement_generation > generation - nu_stale_generations;) {
+		for (int i = 0; i < DETEX_BATCH_SIZE; i++)
+			detexGetCandidate <block_size, Seed, Mutate>(block_info, rng, generation + i,
+				analytic_bitstrings, nu_analytic_seeds, bitstring_out, params,
+				&bitstrings[i * 16]);
+		SetPixelsBatch(block_info, bitstrings, best_error, errors);
+		for (int i = 0; i < DETEX_BATCH_SIZE; i++)
+			if (errors[i] < best_error) {
+				best_error = errors[i];
+				memcpy(bitstring_out, &bitstrings[i * 16], block_size);
+				last_improvement_generation = generation + i;
+			}
+		generation += DETEX_BATCH_SIZE;
+		if ((double)best_error <= target_error)
+			break;
+	}
+	return sqrt((double)best_error / 16.0d);
+}
+
+// Encode a block with the best of its analytic seeds, without a search, for formats whose
+// analytic seeds include a fit of the block (DETEX_COMPRESS_FLAG_ANALYTIC).
+template <class ErrorType, int block_size,
+int (*AnalyticSeed)(const detexBlockInfo *info, uint8_t *bitstrings),
+ErrorType (*SetPixels)(const detexBlockInfo *info, uint8_t *bitstring, ErrorType bound)>
+double detexCompressBlockAnalytic(const detexBlockInfo * DETEX_RESTRICT block_info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring_out, const detexCompressionParameters * DETEX_RESTRICT params) {
+	uint8_t analytic_bitstrings[DETEX_MAX_ANALYTIC_SEEDS * 16];
+	int nu_analytic_seeds = AnalyticSeed(block_info, analytic_bitstrings);
+	ErrorType best_error = detexErrorLimits <ErrorType>::Max();
+	for (int i = 0; i < nu_analytic_seeds; i++) {
+		ErrorType error = SetPixels(block_info, &analytic_bitstrings[i * 16], best_error);
+		if (error < best_error) {
+			best_error = error;
+			memcpy(bitstring_out, &analytic_bitstrings[i * 16], block_size);
+		}
+	}
+	// Without seeds (when no pixel contributes to the seeds), any encoding will do.
+	if (nu_analytic_seeds == 0) {
+		memset(bitstring_out, 0, block_size);
+		best_error = SetPixels(block_info, bitstring_out, detexErrorLimits <ErrorType>::Max());
+	}
+	return sqrt((double)best_error / 16.0d);
+}
+
 static DETEX_INLINE_ONLY uint32_t GetPixelErrorRGB8(int r1, int g1, int b1, int r2, int g2, int b2) {
 	uint32_t error = (r1 - r2) * (r1 - r2);
 	error += (g1 - g2) * (g1 - g2);
@@ -88,36 +302,115 @@ static DETEX_INLINE_ONLY uint32_t GetPixelErrorRGBA8(int r1, int g1, int b1, int
 uint32_t detexCalculateErrorRGBA8(const detexTexture *texture, int x, int y, uint8_t *pixel_buffer);
 
 // BC1
+// Maximum number of candidates of GetAnalyticColorsBC1().
+#define DETEX_BC1_MAX_ANALYTIC_COLORS 6
 void SeedBC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring);
+int AnalyticSeedBC1(const detexBlockInfo *info, uint8_t *bitstrings);
+int GetAnalyticColorsBC1(const detexBlockInfo *info, int mode, int alpha_threshold, uint32_t *colors);
+bool EncodeTrivialBC1(const detexBlockInfo *info, uint8_t *bitstring);
+bool EncodeTrivialColorsBC1(const detexBlockInfo *info, int mode, uint8_t *bitstring);
 void MutateBC1(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring);
-uint32_t SetPixelsBC1(const detexBlockInfo *info, uint8_t *bitstring);
+uint32_t SetPixelsBC1(const detexBlockInfo *info, uint8_t *bitstring, uint32_t bound);
+void SetPixelsBatchBC1(const detexBlockInfo *info, uint8_t *bitstrings, uint32_t bound,
+	uint32_t *errors);
+double CompressBlockBC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+double CompressBlockAnalyticBC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#ifdef DETEX_AVX2_KERNELS
+DETEX_TARGET_AVX2 void SetPixelsBatchBC1AVX2(const detexBlockInfo *info, uint8_t *bitstrings,
+	uint32_t bound, uint32_t *errors);
+double CompressBlockBC1AVX2(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#endif
 
 // BC1A
 const int *GetModesBC1A(const detexBlockInfo *info);
-uint32_t SetPixelsBC1A(const detexBlockInfo *info, uint8_t *bitstring);
+int AnalyticSeedBC1A(const detexBlockInfo *info, uint8_t *bitstrings);
+bool EncodeTrivialBC1A(const detexBlockInfo *info, uint8_t *bitstring);
+uint32_t SetPixelsBC1A(const detexBlockInfo *info, uint8_t *bitstring, uint32_t bound);
+double CompressBlockBC1A(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+double CompressBlockAnalyticBC1A(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
 
 // BC2
-void SeedBC2(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring);
-void MutateBC2(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring);
-uint32_t SetPixelsBC2(const detexBlockInfo *info, uint8_t *bitstring);
+int AnalyticSeedColorsBC2BC3(const detexBlockInfo *info, uint8_t *bitstrings);
+bool EncodeTrivialBC2(const detexBlockInfo *info, uint8_t *bitstring);
+double CompressBlockBC2(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#ifdef DETEX_AVX2_KERNELS
+double CompressBlockBC2AVX2(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#endif
 
 // BC3
-void SeedBC3(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring);
-void MutateBC3(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring);
-uint32_t SetPixelsBC3(const detexBlockInfo *info, uint8_t *bitstring);
+int AnalyticSeedAlphaBC3(const detexBlockInfo *info, uint8_t *bitstrings);
+bool EncodeTrivialBC3(const detexBlockInfo *info, uint8_t *bitstring);
+uint32_t SetAlphaPixelsBC3(const detexBlockInfo *info, uint8_t *bitstring, uint32_t bound);
+double CompressBlockBC3(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#ifdef DETEX_AVX2_KERNELS
+double CompressBlockBC3AVX2(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#endif
 
 // BC4_UNORM/RGTC1
 void SeedRGTC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring);
+int AnalyticSeedRGTC1(const detexBlockInfo *info, uint8_t *bitstrings);
+int GetAnalyticValuesRGTC1(const int *values, int mode, uint32_t *value_pairs);
+bool EncodeTrivialRGTC1(const detexBlockInfo *info, uint8_t *bitstring);
+bool EncodeExactValuesRGTC1(const int *values, uint8_t *bitstring);
 void MutateRGTC1(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring);
-uint32_t SetPixelsRGTC1(const detexBlockInfo *info, uint8_t *bitstring);
+uint32_t SetPixelsRGTC1(const detexBlockInfo *info, uint8_t *bitstring, uint32_t bound);
+void SetPixelsBatchRGTC1(const detexBlockInfo *info, uint8_t *bitstrings, uint32_t bound,
+	uint32_t *errors);
+#ifdef __SSE2__
+uint32_t SetPixelIndicesSIMD8Levels(const uint8_t *pix_orig, int stride_orig, int pixel_size,
+	int component, const int *palette, uint64_t &pixel_indices);
+#endif
+double CompressBlockRGTC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+uint32_t CompressValuesExhaustiveRGTC1(const int *values, int mode, uint8_t *bitstring);
+double CompressBlockExhaustiveRGTC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+uint32_t CompressValuesAnalyticRGTC1(const int *values, int mode, uint8_t *bitstring);
+double CompressBlockAnalyticRGTC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#ifdef DETEX_AVX2_KERNELS
+DETEX_TARGET_AVX2 void SetPixelsBatchRGTC1AVX2(const detexBlockInfo *info, uint8_t *bitstrings,
+	uint32_t bound, uint32_t *errors);
+double CompressBlockRGTC1AVX2(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#endif
 
 // BC4_SNORM/SIGNED_RGTC1
 void SeedSignedRGTC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring);
+int AnalyticSeedSignedRGTC1(const detexBlockInfo *info, uint8_t *bitstrings);
+bool EncodeTrivialSignedRGTC1(const detexBlockInfo *info, uint8_t *bitstring);
 void MutateSignedRGTC1(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring);
-uint64_t SetPixelsSignedRGTC1(const detexBlockInfo *info, uint8_t *bitstring);
+uint64_t SetPixelsSignedRGTC1(const detexBlockInfo *info, uint8_t *bitstring, uint64_t bound);
+double CompressBlockSignedRGTC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
 
 // ETC1
 void SeedETC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring);
+int AnalyticSeedETC1(const detexBlockInfo *info, uint8_t *bitstrings);
+bool EncodeTrivialETC1(const detexBlockInfo *info, uint8_t *bitstring);
 void MutateETC1(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring);
-uint32_t SetPixelsETC1(const detexBlockInfo *info, uint8_t *bitstring);
+void MutateColorsETC1(const detexBlockInfo *info, dstCMWCRNG *rng, int generation, uint8_t *bitstring);
+uint32_t SetPixelsETC1(const detexBlockInfo *info, uint8_t *bitstring, uint32_t bound);
+uint32_t SetPixelsHybridETC1(const detexBlockInfo *info, uint8_t *bitstring, uint32_t bound);
+double CompressBlockETC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+double CompressBlockAnalyticETC1(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#ifdef DETEX_AVX2_KERNELS
+DETEX_TARGET_AVX2 uint32_t SetPixelsETC1AVX2(const detexBlockInfo *info, uint8_t *bitstring,
+	uint32_t bound);
+DETEX_TARGET_AVX2 uint32_t SetPixelsHybridETC1AVX2(const detexBlockInfo *info, uint8_t *bitstring,
+	uint32_t bound);
+double CompressBlockETC1AVX2(const detexBlockInfo *info, dstCMWCRNG *rng, uint8_t *bitstring,
+	const detexCompressionParameters *params);
+#endif
 
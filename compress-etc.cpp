@@ -16,12 +16,17 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 */
 
+#include <limits.h>
+#include <float.h>
+#include <math.h>
 #include <dstRandom.h>
 #ifdef __SSE2__
 #define DST_SIMD_MODE_SSE2
 #include <dstSIMD.h>
+#include <immintrin.h>
 #endif
 #include "detex.h"
+#include "compress.h"
 #include "compress-block.h"
 
 // Components: red1, green1, blue1, red2, green2, blue2, code_word1, code_word2
@@ -64,8 +69,8 @@ static const int8_t detex_etc1_mutation_table1[16][8] = {
 	{ 3, 4, 5, -1, 0, 0, 0, 0 },	// red2, green2, blue2
 	{ 3, 4, 5, -1, 0, 0, 0, 0 },	// red2, green2, blue2
 	{ 0, 1, 2, 3, 4, 5, -1, 0 },	// red1, green1, blue1, red2, green2, blue2
-	{ 6, 7, 0, 0, 0, 0, 0, 0 },	// codeword1, codeword2
-	{ 6, 7, 0, 0, 0, 0, 0, 0 },	// codeword1, codeword2
+	{ 6, 7, -1, 0, 0, 0, 0, 0 },	// codeword1, codeword2
+	{ 6, 7, -1, 0, 0, 0, 0, 0 },	// codeword1, codeword2
 };
 
 static const int8_t detex_etc1_mutation_table2[16][8] = {
@@ -304,6 +309,17 @@ uint8_t * DETEX_RESTRICT bitstring) {
 		return MutateETC1Individual(info, rng, generation, bitstring);
 }
 
+// Mutation for the hybrid search (DETEX_COMPRESS_FLAG_HYBRID), which only mutates the base
+// colors because SetPixelsHybridETC1() selects the table codewords. Mutations that only
+// change the table codewords are repeated.
+void MutateColorsETC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng, int generation,
+uint8_t * DETEX_RESTRICT bitstring) {
+	uint32_t colors = *(uint32_t *)bitstring;
+	do {
+		MutateETC1(info, rng, generation, bitstring);
+	} while (((*(uint32_t *)bitstring ^ colors) & 0x00FFFFFF) == 0);
+}
+
 static const int modifier_table[8][4] = {
 	{ 2, 8, -2, -8 },
 	{ 5, 17, -5, -17 },
@@ -315,6 +331,454 @@ static const int modifier_table[8][4] = {
 	{ 47, 183, -47, -183 }
 };
 
+// Determine the error of the best table codeword for the pixels of a subblock with the given
+// (expanded) base color and store the codewords ordered from lowest to highest error.
+static void OrderTableCodewordsETC1(const int (* DETEX_RESTRICT pixels)[3], const int * DETEX_RESTRICT base_color,
+int * DETEX_RESTRICT codewords) {
+	uint32_t errors[8];
+	for (int cw = 0; cw < 8; cw++) {
+		uint32_t error = 0;
+		for (int i = 0; i < 8; i++) {
+			uint32_t best_error = UINT_MAX;
+			for (int j = 0; j < 4; j++) {
+				int modifier = modifier_table[cw][j];
+				uint32_t e = GetPixelErrorRGB8(pixels[i][0], pixels[i][1], pixels[i][2],
+					detexClamp0To255(base_color[0] + modifier),
+					detexClamp0To255(base_color[1] + modifier),
+					detexClamp0To255(base_color[2] + modifier));
+				if (e < best_error)
+					best_error = e;
+			}
+			error += best_error;
+		}
+		// Insertion sort.
+		int k = cw;
+		for (; k > 0 && errors[k - 1] > error; k--) {
+			errors[k] = errors[k - 1];
+			codewords[k] = codewords[k - 1];
+		}
+		errors[k] = error;
+		codewords[k] = cw;
+	}
+}
+
+// Gather the pixels of the four subblocks (halves) of the block that the modes share: the left
+// and right halves (subblocks 0 and 1, flip bit 0) and the top and bottom halves (subblocks 2
+// and 3, flip bit 1).
+static void GetSubblockPixelsETC1(const detexBlockInfo * DETEX_RESTRICT info, int (* DETEX_RESTRICT pixels)[8][3]) {
+	const detexBlockPixels *block_pixels = info->pixels;
+	int n[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		int subblock[2] = { (i & 3) >> 1, 2 + (i >> 3) };
+		for (int k = 0; k < 2; k++) {
+			int *p = pixels[subblock[k]][n[subblock[k]]];
+			p[0] = block_pixels->r[i];
+			p[1] = block_pixels->g[i];
+			p[2] = block_pixels->b[i];
+			n[subblock[k]]++;
+		}
+	}
+}
+
+static DETEX_INLINE_ONLY int ExpandBaseColorComponentETC1(int value, int differential) {
+	if (differential)
+		return (value << 3) | (value >> 2);
+	else
+		return value | (value << 4);
+}
+
+#ifndef __SSE2__
+
+// Calculate the error of the pixels of a subblock with the given (expanded) base color and
+// table codeword, using the best modifier for each pixel.
+static uint32_t GetSubblockErrorETC1(const int (* DETEX_RESTRICT pixels)[3], const int * DETEX_RESTRICT base_color,
+int table_codeword, uint32_t bound) {
+	int colors[4][3];
+	for (int j = 0; j < 4; j++) {
+		int modifier = modifier_table[table_codeword][j];
+		colors[j][0] = detexClamp0To255(base_color[0] + modifier);
+		colors[j][1] = detexClamp0To255(base_color[1] + modifier);
+		colors[j][2] = detexClamp0To255(base_color[2] + modifier);
+	}
+	uint32_t error = 0;
+	for (int i = 0; i < 8; i++) {
+		uint32_t best_error = UINT_MAX;
+		for (int j = 0; j < 4; j++) {
+			uint32_t e = GetPixelErrorRGB8(pixels[i][0], pixels[i][1], pixels[i][2],
+				colors[j][0], colors[j][1], colors[j][2]);
+			if (e < best_error)
+				best_error = e;
+		}
+		error += best_error;
+		if (error >= bound)
+			break;
+	}
+	return error;
+}
+
+#endif
+
+#ifdef __SSE2__
+
+// Load the components of the staged pixels of the block as 16-bit values, rows 0-1 (pixels
+// 0-7) in the first register and rows 2-3 in the second.
+static DETEX_INLINE_ONLY void LoadBlockPixelsSIMDETC1(const detexBlockPixels * DETEX_RESTRICT pixels,
+__simd128_int * DETEX_RESTRICT m_r, __simd128_int * DETEX_RESTRICT m_g, __simd128_int * DETEX_RESTRICT m_b) {
+	__simd128_int m_zero = simd128_set_zero_int();
+	__simd128_int m_pixels_r = _mm_load_si128((const __m128i *)pixels->r);
+	__simd128_int m_pixels_g = _mm_load_si128((const __m128i *)pixels->g);
+	__simd128_int m_pixels_b = _mm_load_si128((const __m128i *)pixels->b);
+	m_r[0] = _mm_unpacklo_epi8(m_pixels_r, m_zero);
+	m_r[1] = _mm_unpackhi_epi8(m_pixels_r, m_zero);
+	m_g[0] = _mm_unpacklo_epi8(m_pixels_g, m_zero);
+	m_g[1] = _mm_unpackhi_epi8(m_pixels_g, m_zero);
+	m_b[0] = _mm_unpacklo_epi8(m_pixels_b, m_zero);
+	m_b[1] = _mm_unpackhi_epi8(m_pixels_b, m_zero);
+}
+
+// SIMD version of GetSubblockErrorETC1(). The components of the eight pixels of the subblock
+// are held as 16-bit values, one component per register, and the errors of the four modifiers
+// are calculated for all pixels at once with _mm_madd_epi16().
+static DETEX_INLINE_ONLY uint32_t GetSubblockErrorSIMDETC1(__simd128_int m_r, __simd128_int m_g, __simd128_int m_b,
+const int * DETEX_RESTRICT base_color, int table_codeword) {
+	__simd128_int m_zero = simd128_set_zero_int();
+	__simd128_int m_best_error[2];
+	for (int j = 0; j < 4; j++) {
+		int modifier = modifier_table[table_codeword][j];
+		__simd128_int m_diff_r = _mm_sub_epi16(m_r, _mm_set1_epi16(detexClamp0To255(base_color[0] + modifier)));
+		__simd128_int m_diff_g = _mm_sub_epi16(m_g, _mm_set1_epi16(detexClamp0To255(base_color[1] + modifier)));
+		__simd128_int m_diff_b = _mm_sub_epi16(m_b, _mm_set1_epi16(detexClamp0To255(base_color[2] + modifier)));
+		__simd128_int m_diff_rg = _mm_unpacklo_epi16(m_diff_r, m_diff_g);
+		__simd128_int m_diff_b0 = _mm_unpacklo_epi16(m_diff_b, m_zero);
+		__simd128_int m_error[2];
+		m_error[0] = simd128_add_int32(_mm_madd_epi16(m_diff_rg, m_diff_rg),
+			_mm_madd_epi16(m_diff_b0, m_diff_b0));
+		m_diff_rg = _mm_unpackhi_epi16(m_diff_r, m_diff_g);
+		m_diff_b0 = _mm_unpackhi_epi16(m_diff_b, m_zero);
+		m_error[1] = simd128_add_int32(_mm_madd_epi16(m_diff_rg, m_diff_rg),
+			_mm_madd_epi16(m_diff_b0, m_diff_b0));
+		for (int l = 0; l < 2; l++) {
+			if (j == 0) {
+				m_best_error[l] = m_error[l];
+				continue;
+			}
+			__simd128_int m_cmp = _mm_cmplt_epi32(m_error[l], m_best_error[l]);
+			m_best_error[l] = simd128_or_int(simd128_andnot_int(m_cmp, m_best_error[l]),
+				simd128_and_int(m_cmp, m_error[l]));
+		}
+	}
+	__simd128_int m_error = simd128_add_int32(m_best_error[0], m_best_error[1]);
+	m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0x4E));
+	m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0xB1));
+	return simd128_get_int32(m_error);
+}
+
+#endif
+
+// The best base color (4-bit or 5-bit components) and table codeword found for a subblock.
+struct SubblockColorsETC1 {
+	int base_color[3];
+	int table_codeword;
+	uint32_t error;
+};
+
+// Search the base color and table codeword of a subblock with the components of the base
+// color limited to the range low to high (inclusive). All table codewords are evaluated with
+// the base color nearest to the mean of the pixels, after which the base color of the two best
+// codewords is refined by a local search over the neighbouring base colors.
+static void SearchSubblockColorsETC1(const int (* DETEX_RESTRICT pixels)[3], int differential,
+const int * DETEX_RESTRICT low, const int * DETEX_RESTRICT high, SubblockColorsETC1 * DETEX_RESTRICT colors) {
+#ifdef __SSE2__
+	__simd128_int m_r = _mm_set_epi16(pixels[7][0], pixels[6][0], pixels[5][0], pixels[4][0],
+		pixels[3][0], pixels[2][0], pixels[1][0], pixels[0][0]);
+	__simd128_int m_g = _mm_set_epi16(pixels[7][1], pixels[6][1], pixels[5][1], pixels[4][1],
+		pixels[3][1], pixels[2][1], pixels[1][1], pixels[0][1]);
+	__simd128_int m_b = _mm_set_epi16(pixels[7][2], pixels[6][2], pixels[5][2], pixels[4][2],
+		pixels[3][2], pixels[2][2], pixels[1][2], pixels[0][2]);
+#endif
+	int max_value = differential ? 31 : 15;
+	int center[3];
+	int expanded[3];
+	for (int c = 0; c < 3; c++) {
+		int sum = 0;
+		for (int i = 0; i < 8; i++)
+			sum += pixels[i][c];
+		center[c] = (sum * max_value + 4 * 255) / (8 * 255);
+		if (center[c] < low[c])
+			center[c] = low[c];
+		if (center[c] > high[c])
+			center[c] = high[c];
+		expanded[c] = ExpandBaseColorComponentETC1(center[c], differential);
+	}
+	int codewords[2] = { 0, 0 };
+	uint32_t errors[2] = { UINT_MAX, UINT_MAX };
+	for (int cw = 0; cw < 8; cw++) {
+#ifdef __SSE2__
+		uint32_t error = GetSubblockErrorSIMDETC1(m_r, m_g, m_b, expanded, cw);
+#else
+		uint32_t error = GetSubblockErrorETC1(pixels, expanded, cw, errors[1]);
+#endif
+		if (error < errors[0]) {
+			codewords[1] = codewords[0];
+			errors[1] = errors[0];
+			codewords[0] = cw;
+			errors[0] = error;
+		}
+		else if (error < errors[1]) {
+			codewords[1] = cw;
+			errors[1] = error;
+		}
+	}
+	colors->error = UINT_MAX;
+	for (int k = 0; k < 2; k++) {
+		int base_color[3] = { center[0], center[1], center[2] };
+		uint32_t best_error = errors[k];
+		for (int iteration = 0; iteration < 4 && best_error > 0; iteration++) {
+			int start[3] = { base_color[0], base_color[1], base_color[2] };
+			bool improved = false;
+			for (int dr = - 1; dr <= 1; dr++)
+				for (int dg = - 1; dg <= 1; dg++)
+					for (int db = - 1; db <= 1; db++) {
+						int candidate[3] = { start[0] + dr, start[1] + dg, start[2] + db };
+						if ((dr | dg | db) == 0 ||
+						candidate[0] < low[0] || candidate[0] > high[0] ||
+						candidate[1] < low[1] || candidate[1] > high[1] ||
+						candidate[2] < low[2] || candidate[2] > high[2])
+							continue;
+						for (int c = 0; c < 3; c++)
+							expanded[c] = ExpandBaseColorComponentETC1(candidate[c], differential);
+#ifdef __SSE2__
+						uint32_t error = GetSubblockErrorSIMDETC1(m_r, m_g, m_b, expanded, codewords[k]);
+#else
+						uint32_t error = GetSubblockErrorETC1(pixels, expanded, codewords[k],
+							best_error);
+#endif
+						if (error < best_error) {
+							best_error = error;
+							base_color[0] = candidate[0];
+							base_color[1] = candidate[1];
+							base_color[2] = candidate[2];
+							improved = true;
+						}
+					}
+			if (!improved)
+				break;
+		}
+		if (best_error < colors->error) {
+			colors->base_color[0] = base_color[0];
+			colors->base_color[1] = base_color[1];
+			colors->base_color[2] = base_color[2];
+			colors->table_codeword = codewords[k];
+			colors->error = best_error;
+		}
+	}
+}
+
+static void SearchSubblockColorsETC1(const int (* DETEX_RESTRICT pixels)[3], int differential,
+SubblockColorsETC1 * DETEX_RESTRICT colors) {
+	int low[3] = { 0, 0, 0 };
+	int max_value = differential ? 31 : 15;
+	int high[3] = { max_value, max_value, max_value };
+	SearchSubblockColorsETC1(pixels, differential, low, high, colors);
+}
+
+// Combine the colors found for the two subblocks of a mode into the color bits of the block
+// (the pixel indices are set later) and return the error. In differential mode, the difference
+// between the base colors must fit in the 3-bit signed field (the condition checked by
+// ColorsAreInvalidETC1Differential()); when it does not, the base color of one of the
+// subblocks is searched again within the range allowed by the other one, and the better of the
+// two combinations is used.
+static uint32_t CombineSubblockColorsETC1(const int (* DETEX_RESTRICT pixels)[8][3], int mode,
+const SubblockColorsETC1 * DETEX_RESTRICT subblock_colors, uint32_t * DETEX_RESTRICT colors_out) {
+	int flip = mode & 1;
+	int subblock1 = flip * 2;
+	int subblock2 = flip * 2 + 1;
+	SubblockColorsETC1 colors[2];
+	colors[0] = subblock_colors[subblock1];
+	colors[1] = subblock_colors[subblock2];
+	if (mode & 2) {
+		bool valid = true;
+		for (int c = 0; c < 3; c++) {
+			int d = colors[1].base_color[c] - colors[0].base_color[c];
+			if (d < - 4 || d > 3)
+				valid = false;
+		}
+		if (!valid) {
+			// Keep the base color of subblock 1 and search subblock 2, or the other way around.
+			SubblockColorsETC1 refined[2];
+			int low[3], high[3];
+			for (int c = 0; c < 3; c++) {
+				low[c] = colors[0].base_color[c] - 4;
+				if (low[c] < 0)
+					low[c] = 0;
+				high[c] = colors[0].base_color[c] + 3;
+				if (high[c] > 31)
+					high[c] = 31;
+			}
+			SearchSubblockColorsETC1(pixels[subblock2], 1, low, high, &refined[1]);
+			for (int c = 0; c < 3; c++) {
+				low[c] = colors[1].base_color[c] - 3;
+				if (low[c] < 0)
+					low[c] = 0;
+				high[c] = colors[1].base_color[c] + 4;
+				if (high[c] > 31)
+					high[c] = 31;
+			}
+			SearchSubblockColorsETC1(pixels[subblock1], 1, low, high, &refined[0]);
+			if (colors[0].error + refined[1].error <= refined[0].error + colors[1].error)
+				colors[1] = refined[1];
+			else
+				colors[0] = refined[0];
+		}
+	}
+	uint32_t bits = 0;
+	for (int c = 0; c < 3; c++)
+		if (mode & 2)
+			bits |= ((colors[0].base_color[c] << 3) |
+				((colors[1].base_color[c] - colors[0].base_color[c]) & 7)) << (c * 8);
+		else
+			bits |= ((colors[0].base_color[c] << 4) | colors[1].base_color[c]) << (c * 8);
+	bits |= (colors[0].table_codeword << 29) | (colors[1].table_codeword << 26) | (mode << 24);
+	*colors_out = bits;
+	return colors[0].error + colors[1].error;
+}
+
+// Derive candidates for the mode (individual/differential, flip bit) with a separable search:
+// the base color and table codeword of each subblock are searched independently, and the
+// results are combined per mode. With non-modal operation, the four subblocks are searched in
+// both the 4-bit (individual) and 5-bit (differential) quantization and the combinations of all
+// four modes are returned, so that the cost of the search is determined by the number of
+// subblocks rather than the number of modes. With modal operation, the candidates from the mean
+// colors of the two subblocks, combined with the table codewords that fit each subblock best,
+// are added.
+int AnalyticSeedETC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings) {
+	int pixels[4][8][3];
+	GetSubblockPixelsETC1(info, pixels);
+	if (info->mode < 0) {
+		SubblockColorsETC1 subblock_colors[2][4];
+		for (int differential = 0; differential < 2; differential++)
+			for (int subblock = 0; subblock < 4; subblock++)
+				SearchSubblockColorsETC1(pixels[subblock], differential,
+					&subblock_colors[differential][subblock]);
+		for (int mode = 0; mode < 4; mode++)
+			CombineSubblockColorsETC1(pixels, mode, subblock_colors[mode >> 1],
+				(uint32_t *)&bitstrings[mode * 16]);
+		return 4;
+	}
+	int flip = info->mode & 1;
+	int differential = info->mode >> 1;
+	SubblockColorsETC1 subblock_colors[4];
+	SearchSubblockColorsETC1(pixels[flip * 2], differential, &subblock_colors[flip * 2]);
+	SearchSubblockColorsETC1(pixels[flip * 2 + 1], differential, &subblock_colors[flip * 2 + 1]);
+	CombineSubblockColorsETC1(pixels, info->mode, subblock_colors, (uint32_t *)&bitstrings[0]);
+	int sum[2][3];
+	for (int i = 0; i < 2; i++)
+		for (int c = 0; c < 3; c++) {
+			sum[i][c] = 0;
+			for (int j = 0; j < 8; j++)
+				sum[i][c] += pixels[flip * 2 + i][j][c];
+		}
+	uint32_t colors = 0;
+	int base_color[2][3];
+	for (int c = 0; c < 3; c++) {
+		if (info->mode & 2) {
+			// Differential mode: a 5-bit base color and a 3-bit signed difference.
+			int q0 = (sum[0][c] * 31 + 4 * 255) / (8 * 255);
+			int q1 = (sum[1][c] * 31 + 4 * 255) / (8 * 255);
+			int d = q1 - q0;
+			if (d < - 4)
+				d = - 4;
+			if (d > 3)
+				d = 3;
+			q1 = q0 + d;
+			colors |= ((q0 << 3) | (d & 7)) << (c * 8);
+			base_color[0][c] = (q0 << 3) | (q0 >> 2);
+			base_color[1][c] = (q1 << 3) | (q1 >> 2);
+		}
+		else {
+			int q0 = (sum[0][c] * 15 + 4 * 255) / (8 * 255);
+			int q1 = (sum[1][c] * 15 + 4 * 255) / (8 * 255);
+			colors |= ((q0 << 4) | q1) << (c * 8);
+			base_color[0][c] = q0 | (q0 << 4);
+			base_color[1][c] = q1 | (q1 << 4);
+		}
+	}
+	colors |= info->mode << 24;
+	int codewords[2][8];
+	OrderTableCodewordsETC1(pixels[flip * 2], base_color[0], codewords[0]);
+	OrderTableCodewordsETC1(pixels[flip * 2 + 1], base_color[1], codewords[1]);
+	// Use the best, second best and third best codeword combinations.
+	for (int i = 0; i < 3; i++)
+		*(uint32_t *)&bitstrings[(i + 1) * 16] = colors | (codewords[0][i] << 29) | (codewords[1][i] << 26);
+	return 4;
+}
+
+// Encode a block that consists of a single color. All pixels use the same modifier, so the
+// best encoding is found by trying every table codeword and modifier with the best base color
+// value for each component, in both individual (4-bit) and differential (5-bit) mode.
+bool EncodeTrivialETC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+	if ((info->flags & DETEX_BLOCK_FLAG_MAX_TWO_COLORS) == 0 || info->colors[0] != info->colors[1])
+		return false;
+	int color[3];
+	color[0] = detexPixel32GetR8(info->colors[0]);
+	color[1] = detexPixel32GetG8(info->colors[0]);
+	color[2] = detexPixel32GetB8(info->colors[0]);
+	uint32_t best_error = UINT_MAX;
+	int best_differential = 0;
+	int best_codeword = 0;
+	int best_pixel_index = 0;
+	int best_base[3] = { 0, 0, 0 };
+	for (int differential = 0; differential < 2; differential++) {
+		int max_value = differential ? 31 : 15;
+		for (int cw = 0; cw < 8; cw++)
+			for (int pixel_index = 0; pixel_index < 4; pixel_index++) {
+				int modifier = modifier_table[cw][pixel_index];
+				uint32_t error = 0;
+				int base[3];
+				for (int c = 0; c < 3; c++) {
+					uint32_t best_component_error = UINT_MAX;
+					for (int q = 0; q <= max_value; q++) {
+						int expanded = differential ? ((q << 3) | (q >> 2)) : (q | (q << 4));
+						int d = detexClamp0To255(expanded + modifier) - color[c];
+						if ((uint32_t)(d * d) < best_component_error) {
+							best_component_error = d * d;
+							base[c] = q;
+						}
+					}
+					error += best_component_error;
+				}
+				if (error < best_error) {
+					best_error = error;
+					best_differential = differential;
+					best_codeword = cw;
+					best_pixel_index = pixel_index;
+					best_base[0] = base[0];
+					best_base[1] = base[1];
+					best_base[2] = base[2];
+				}
+			}
+	}
+	// Both subblocks use the same base color and table codeword (flip bit 0).
+	uint32_t colors = 0;
+	for (int c = 0; c < 3; c++)
+		if (best_differential)
+			colors |= (best_base[c] << 3) << (c * 8);
+		else
+			colors |= ((best_base[c] << 4) | best_base[c]) << (c * 8);
+	colors |= (best_differential << 25) | (best_codeword << 29) | (best_codeword << 26);
+	*(uint32_t *)bitstring = colors;
+	uint32_t pixel_indices = 0;
+	if (best_pixel_index & 1)
+		pixel_indices |= 0xFFFF;
+	if (best_pixel_index & 2)
+		pixel_indices |= 0xFFFF0000;
+	bitstring[4] = pixel_indices >> 24;
+	bitstring[5] = pixel_indices >> 16;
+	bitstring[6] = pixel_indices >> 8;
+	bitstring[7] = pixel_indices;
+	return true;
+}
+
 static DETEX_INLINE_ONLY uint32_t GetPixelErrorETC1(int r_orig, int g_orig, int b_orig, uint32_t table_codeword,
 int *base_color, int pixel_index) {
 	int modifier = modifier_table[table_codeword][pixel_index];
@@ -353,6 +817,130 @@ uint32_t table_codeword, int * DETEX_RESTRICT base_color, uint32_t & DETEX_RESTR
 	return best_error;
 }
 
+#ifdef __SSE2__
+
+static DETEX_INLINE_ONLY __simd128_int SelectInt16(__simd128_int m_mask, __simd128_int m_value_if_set,
+__simd128_int m_value_if_not_set) {
+	return simd128_or_int(simd128_and_int(m_mask, m_value_if_set),
+		simd128_andnot_int(m_mask, m_value_if_not_set));
+}
+
+// Pixel-parallel kernel for the SetPixelsETC1Mode*() functions. The components of the block
+// are held as 16-bit values (two rows, eight pixels, per register), and the base color and
+// modifiers of the subblock each pixel belongs to are selected with masks (flip bit 0: left
+// and right subblocks, flip bit 1: top and bottom). For each of the four pixel indices the
+// modified colors of all pixels are clamped with packed 16-bit min/max (which is exact for
+// the out-of-range base colors that differential mode can produce), the errors are summed
+// with _mm_madd_epi16() and the lowest error is selected with compares and masks. The pixel
+// indices are packed into the ETC1 layout (the LSB of the index of pixel (dx, dy) at bit
+// dy + dx * 4, the MSB 16 bits higher) in the SIMD registers.
+static DETEX_INLINE_ONLY uint32_t SetPixelsSIMDETC1(const detexBlockInfo * DETEX_RESTRICT info,
+const int * DETEX_RESTRICT base_color_subblock1, const int * DETEX_RESTRICT base_color_subblock2,
+const int * DETEX_RESTRICT table_codeword, int flip, uint32_t bound,
+uint32_t & DETEX_RESTRICT pixel_indices) {
+	__simd128_int m_zero = simd128_set_zero_int();
+	// Rows 0-1 and rows 2-3 of the block, one component per register, and the masks of the
+	// pixels that belong to subblock 2.
+	__simd128_int m_r[2], m_g[2], m_b[2], m_subblock2[2];
+	LoadBlockPixelsSIMDETC1(info->pixels, m_r, m_g, m_b);
+	for (int j = 0; j < 2; j++) {
+		if (flip == 0)
+			m_subblock2[j] = _mm_set_epi16(-1, -1, 0, 0, -1, -1, 0, 0);
+		else
+			m_subblock2[j] = _mm_set1_epi16(- j);
+	}
+	__simd128_int m_base_r[2], m_base_g[2], m_base_b[2];
+	for (int j = 0; j < 2; j++) {
+		m_base_r[j] = SelectInt16(m_subblock2[j], _mm_set1_epi16(base_color_subblock2[0]),
+			_mm_set1_epi16(base_color_subblock1[0]));
+		m_base_g[j] = SelectInt16(m_subblock2[j], _mm_set1_epi16(base_color_subblock2[1]),
+			_mm_set1_epi16(base_color_subblock1[1]));
+		m_base_b[j] = SelectInt16(m_subblock2[j], _mm_set1_epi16(base_color_subblock2[2]),
+			_mm_set1_epi16(base_color_subblock1[2]));
+	}
+	__simd128_int m_255 = _mm_set1_epi16(255);
+	__simd128_int m_best_error[4];
+	__simd128_int m_best_pixel_index[4];
+	// Rows 0-1 are evaluated first, so that the evaluation can stop when their error already
+	// reaches the bound.
+	for (int j = 0; j < 2; j++) {
+		for (int k = 0; k < 4; k++) {
+			__simd128_int m_pixel_index = simd128_set_same_int32(k);
+			__simd128_int m_modifier = SelectInt16(m_subblock2[j],
+				_mm_set1_epi16(modifier_table[table_codeword[1]][k]),
+				_mm_set1_epi16(modifier_table[table_codeword[0]][k]));
+			__simd128_int m_color_r = _mm_min_epi16(_mm_max_epi16(
+				_mm_add_epi16(m_base_r[j], m_modifier), m_zero), m_255);
+			__simd128_int m_color_g = _mm_min_epi16(_mm_max_epi16(
+				_mm_add_epi16(m_base_g[j], m_modifier), m_zero), m_255);
+			__simd128_int m_color_b = _mm_min_epi16(_mm_max_epi16(
+				_mm_add_epi16(m_base_b[j], m_modifier), m_zero), m_255);
+			__simd128_int m_diff_r = _mm_sub_epi16(m_r[j], m_color_r);
+			__simd128_int m_diff_g = _mm_sub_epi16(m_g[j], m_color_g);
+			__simd128_int m_diff_b = _mm_sub_epi16(m_b[j], m_color_b);
+			__simd128_int m_diff_rg = _mm_unpacklo_epi16(m_diff_r, m_diff_g);
+			__simd128_int m_diff_b0 = _mm_unpacklo_epi16(m_diff_b, m_zero);
+			__simd128_int m_error[2];
+			m_error[0] = simd128_add_int32(_mm_madd_epi16(m_diff_rg, m_diff_rg),
+				_mm_madd_epi16(m_diff_b0, m_diff_b0));
+			m_diff_rg = _mm_unpackhi_epi16(m_diff_r, m_diff_g);
+			m_diff_b0 = _mm_unpackhi_epi16(m_diff_b, m_zero);
+			m_error[1] = simd128_add_int32(_mm_madd_epi16(m_diff_rg, m_diff_rg),
+				_mm_madd_epi16(m_diff_b0, m_diff_b0));
+			for (int l = 0; l < 2; l++) {
+				int row = j * 2 + l;
+				if (k == 0) {
+					m_best_error[row] = m_error[l];
+					m_best_pixel_index[row] = m_zero;
+					continue;
+				}
+				// Like the scalar version, keep the first index with the lowest error.
+				__simd128_int m_cmp = _mm_cmplt_epi32(m_error[l], m_best_error[row]);
+				m_best_error[row] = simd128_or_int(
+					simd128_andnot_int(m_cmp, m_best_error[row]),
+					simd128_and_int(m_cmp, m_error[l]));
+				m_best_pixel_index[row] = simd128_or_int(
+					simd128_andnot_int(m_cmp, m_best_pixel_index[row]),
+					simd128_and_int(m_cmp, m_pixel_index));
+			}
+		}
+		if (j == 0) {
+			__simd128_int m_error = simd128_add_int32(m_best_error[0], m_best_error[1]);
+			m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0x4E));
+			m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0xB1));
+			uint32_t error = simd128_get_int32(m_error);
+			if (error >= bound) {
+				pixel_indices = 0;
+				return error;
+			}
+		}
+	}
+	// Sum the errors of all pixels.
+	__simd128_int m_error = simd128_add_int32(
+		simd128_add_int32(m_best_error[0], m_best_error[1]),
+		simd128_add_int32(m_best_error[2], m_best_error[3]));
+	m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0x4E));
+	m_error = simd128_add_int32(m_error, _mm_shuffle_epi32(m_error, 0xB1));
+	// Put the LSB of each index at bit 0 and the MSB at bit 16 of its lane, shift by the row
+	// (dy) and multiply both 16-bit halves by 1 << (dx * 4), then combine all pixels.
+	__simd128_int m_column_shift = _mm_set_epi32(0x10001000, 0x01000100, 0x00100010, 0x00010001);
+	__simd128_int m_one = simd128_set_same_int32(1);
+	__simd128_int m_indices = m_zero;
+	for (int row = 0; row < 4; row++) {
+		__simd128_int m_bits = simd128_or_int(
+			simd128_and_int(m_best_pixel_index[row], m_one),
+			_mm_slli_epi32(simd128_and_int(_mm_srli_epi32(m_best_pixel_index[row], 1), m_one), 16));
+		m_bits = _mm_sll_epi32(m_bits, _mm_cvtsi32_si128(row));
+		m_indices = simd128_or_int(m_indices, _mm_mullo_epi16(m_bits, m_column_shift));
+	}
+	m_indices = simd128_or_int(m_indices, _mm_shuffle_epi32(m_indices, 0x4E));
+	m_indices = simd128_or_int(m_indices, _mm_shuffle_epi32(m_indices, 0xB1));
+	pixel_indices = simd128_get_int32(m_indices);
+	return simd128_get_int32(m_error);
+}
+
+#endif
+
 static DETEX_INLINE_ONLY void DecodeColorsETC1ModeIndividual(uint32_t colors,
 int * DETEX_RESTRICT base_color_subblock1, int * DETEX_RESTRICT base_color_subblock2,
 int * DETEX_RESTRICT table_codeword) {
@@ -401,7 +989,7 @@ int * DETEX_RESTRICT table_codeword) {
 }
 
 static uint32_t SetPixelsETC1ModeIndividualFlipBit0(const detexBlockInfo * DETEX_RESTRICT info,
-uint8_t * DETEX_RESTRICT bitstring) {
+uint8_t * DETEX_RESTRICT bitstring, uint32_t bound) {
 	// Decode colors.
 	uint32_t colors = *(uint32_t *)&bitstring[0];
 	// Decode the two base colors.
@@ -410,29 +998,41 @@ uint8_t * DETEX_RESTRICT bitstring) {
 	int table_codeword[2];
 	DecodeColorsETC1ModeIndividual(colors, base_color_subblock1, base_color_subblock2, table_codeword);
 	// Set pixels indices.
+	uint32_t pixel_indices;
+#ifdef __SSE2__
+	uint32_t error = SetPixelsSIMDETC1(info, base_color_subblock1, base_color_subblock2, table_codeword,
+		0, bound, pixel_indices);
+#else
 	const detexTexture *texture = info->texture;
 	int x = info->x;
 	int y = info->y;
 	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 4;
 	int stride_orig = texture->width * 4;
-	uint32_t pixel_indices = 0;
+	pixel_indices = 0;
 	uint32_t error = 0;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 2, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 3, table_codeword[0], base_color_subblock1, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 2, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 3, table_codeword[0], base_color_subblock1, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 0, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 1, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 0, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 1, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+#endif
 	bitstring[4] = pixel_indices >> 24;
 	bitstring[5] = pixel_indices >> 16;
 	bitstring[6] = pixel_indices >> 8;
@@ -441,7 +1041,7 @@ uint8_t * DETEX_RESTRICT bitstring) {
 }
 
 static uint32_t SetPixelsETC1ModeIndividualFlipBit1(const detexBlockInfo * DETEX_RESTRICT info,
-uint8_t * DETEX_RESTRICT bitstring) {
+uint8_t * DETEX_RESTRICT bitstring, uint32_t bound) {
 	// Decode colors.
 	uint32_t colors = *(uint32_t *)&bitstring[0];
 	// Decode the two base colors.
@@ -450,29 +1050,41 @@ uint8_t * DETEX_RESTRICT bitstring) {
 	int table_codeword[2];
 	DecodeColorsETC1ModeIndividual(colors, base_color_subblock1, base_color_subblock2, table_codeword);
 	// Set pixels indices.
+	uint32_t pixel_indices;
+#ifdef __SSE2__
+	uint32_t error = SetPixelsSIMDETC1(info, base_color_subblock1, base_color_subblock2, table_codeword,
+		1, bound, pixel_indices);
+#else
 	const detexTexture *texture = info->texture;
 	int x = info->x;
 	int y = info->y;
 	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 4;
 	int stride_orig = texture->width * 4;
-	uint32_t pixel_indices = 0;
+	pixel_indices = 0;
 	uint32_t error = 0;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+#endif
 	bitstring[4] = pixel_indices >> 24;
 	bitstring[5] = pixel_indices >> 16;
 	bitstring[6] = pixel_indices >> 8;
@@ -481,7 +1093,7 @@ uint8_t * DETEX_RESTRICT bitstring) {
 }
 
 static uint32_t SetPixelsETC1ModeDifferentialFlipBit0(const detexBlockInfo * DETEX_RESTRICT info,
-uint8_t * DETEX_RESTRICT bitstring) {
+uint8_t * DETEX_RESTRICT bitstring, uint32_t bound) {
 	// Decode colors.
 	uint32_t colors = *(uint32_t *)&bitstring[0];
 	// Decode the two base colors.
@@ -490,29 +1102,41 @@ uint8_t * DETEX_RESTRICT bitstring) {
 	int table_codeword[2];
 	DecodeColorsETC1ModeDifferential(colors, base_color_subblock1, base_color_subblock2, table_codeword);
 	// Set pixels indices.
+	uint32_t pixel_indices;
+#ifdef __SSE2__
+	uint32_t error = SetPixelsSIMDETC1(info, base_color_subblock1, base_color_subblock2, table_codeword,
+		0, bound, pixel_indices);
+#else
 	const detexTexture *texture = info->texture;
 	int x = info->x;
 	int y = info->y;
 	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 4;
 	int stride_orig = texture->width * 4;
-	uint32_t pixel_indices = 0;
+	pixel_indices = 0;
 	uint32_t error = 0;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 2, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 3, table_codeword[0], base_color_subblock1, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 2, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 3, table_codeword[0], base_color_subblock1, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 0, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 1, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 0, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 1, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+#endif
 	bitstring[4] = pixel_indices >> 24;
 	bitstring[5] = pixel_indices >> 16;
 	bitstring[6] = pixel_indices >> 8;
@@ -521,7 +1145,7 @@ uint8_t * DETEX_RESTRICT bitstring) {
 }
 
 static uint32_t SetPixelsETC1ModeDifferentialFlipBit1(const detexBlockInfo * DETEX_RESTRICT info,
-uint8_t * DETEX_RESTRICT bitstring) {
+uint8_t * DETEX_RESTRICT bitstring, uint32_t bound) {
 	// Decode colors.
 	uint32_t colors = *(uint32_t *)&bitstring[0];
 	// Decode the two base colors.
@@ -530,29 +1154,41 @@ uint8_t * DETEX_RESTRICT bitstring) {
 	int table_codeword[2];
 	DecodeColorsETC1ModeDifferential(colors, base_color_subblock1, base_color_subblock2, table_codeword);
 	// Set pixels indices.
+	uint32_t pixel_indices;
+#ifdef __SSE2__
+	uint32_t error = SetPixelsSIMDETC1(info, base_color_subblock1, base_color_subblock2, table_codeword,
+		1, bound, pixel_indices);
+#else
 	const detexTexture *texture = info->texture;
 	int x = info->x;
 	int y = info->y;
 	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 4;
 	int stride_orig = texture->width * 4;
-	uint32_t pixel_indices = 0;
+	pixel_indices = 0;
 	uint32_t error = 0;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 0, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 1, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 2, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+	if (error >= bound)
+		return error;
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 0, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 1, table_codeword[0], base_color_subblock1, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 2, table_codeword[1], base_color_subblock2, pixel_indices);
 	error += SetPixelXYETC1(pix_orig, stride_orig, 3, 3, table_codeword[1], base_color_subblock2, pixel_indices);
+#endif
 	bitstring[4] = pixel_indices >> 24;
 	bitstring[5] = pixel_indices >> 16;
 	bitstring[6] = pixel_indices >> 8;
@@ -562,17 +1198,318 @@ uint8_t * DETEX_RESTRICT bitstring) {
 
 // Set the pixel indices of the compressed block using the available colors so that they
 // most closely match the original block. Return the comparison error value.
-uint32_t SetPixelsETC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+uint32_t SetPixelsETC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring,
+uint32_t bound) {
 	int ETC1_mode = bitstring[3] & 3;
 	switch (ETC1_mode) {
 	case 0 :
-		return SetPixelsETC1ModeIndividualFlipBit0(info, bitstring);
+		return SetPixelsETC1ModeIndividualFlipBit0(info, bitstring, bound);
 	case 1 :
-		return SetPixelsETC1ModeIndividualFlipBit1(info, bitstring);
+		return SetPixelsETC1ModeIndividualFlipBit1(info, bitstring, bound);
 	case 2 :
-		return SetPixelsETC1ModeDifferentialFlipBit0(info, bitstring);
+		return SetPixelsETC1ModeDifferentialFlipBit0(info, bitstring, bound);
 	case 3 :
-		return SetPixelsETC1ModeDifferentialFlipBit1(info, bitstring);
+		return SetPixelsETC1ModeDifferentialFlipBit1(info, bitstring, bound);
+	}
+}
+
+#ifdef __SSE2__
+
+// Load the components of the pixels of the two subblocks of the given flip bit as 16-bit
+// values, one subblock (eight pixels, in any order) per register.
+static DETEX_INLINE_ONLY void LoadSubblockPixelsSIMDETC1(const detexBlockInfo * DETEX_RESTRICT info, int flip,
+__simd128_int * DETEX_RESTRICT m_r, __simd128_int * DETEX_RESTRICT m_g, __simd128_int * DETEX_RESTRICT m_b) {
+	// Rows 0-1 and rows 2-3 of the block are the top and bottom subblocks.
+	LoadBlockPixelsSIMDETC1(info->pixels, m_r, m_g, m_b);
+	if (flip)
+		return;
+	__simd128_int *m_components[3] = { m_r, m_g, m_b };
+	for (int c = 0; c < 3; c++) {
+		// Gather the pixel pairs with dx 0-1 and dx 2-3 of each row (32-bit lanes 0, 2 and
+		// 1, 3) for the left and right subblocks.
+		__simd128_int m_top = _mm_shuffle_epi32(m_components[c][0], 0xD8);
+		__simd128_int m_bottom = _mm_shuffle_epi32(m_components[c][1], 0xD8);
+		m_components[c][0] = _mm_unpacklo_epi64(m_top, m_bottom);
+		m_components[c][1] = _mm_unpackhi_epi64(m_top, m_bottom);
+	}
+}
+
+#endif
+
+// Set the table codewords and pixel indices of the hybrid search (DETEX_COMPRESS_FLAG_HYBRID):
+// for the base colors of the candidate, the best of the eight table codewords of each
+// subblock is selected exhaustively. Return the comparison error.
+uint32_t SetPixelsHybridETC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring,
+uint32_t bound) {
+	uint32_t colors = *(uint32_t *)&bitstring[0];
+	int base_color[2][3];
+	int table_codeword[2];
+	if (bitstring[3] & 2)
+		DecodeColorsETC1ModeDifferential(colors, base_color[0], base_color[1], table_codeword);
+	else
+		DecodeColorsETC1ModeIndividual(colors, base_color[0], base_color[1], table_codeword);
+	int flip = bitstring[3] & 1;
+#ifdef __SSE2__
+	__simd128_int m_r[2], m_g[2], m_b[2];
+	LoadSubblockPixelsSIMDETC1(info, flip, m_r, m_g, m_b);
+#else
+	int pixels[4][8][3];
+	GetSubblockPixelsETC1(info, pixels);
+#endif
+	uint32_t error = 0;
+	for (int i = 0; i < 2; i++) {
+		uint32_t best_error = UINT_MAX;
+		for (int cw = 0; cw < 8; cw++) {
+#ifdef __SSE2__
+			uint32_t e = GetSubblockErrorSIMDETC1(m_r[i], m_g[i], m_b[i], base_color[i], cw);
+#else
+			uint32_t e = GetSubblockErrorETC1(pixels[flip * 2 + i], base_color[i], cw, best_error);
+#endif
+			if (e < best_error) {
+				best_error = e;
+				table_codeword[i] = cw;
+			}
+		}
+		error += best_error;
+		if (error >= bound)
+			return error;
+	}
+	colors = (colors & 0x03FFFFFF) | (table_codeword[0] << 29) | (table_codeword[1] << 26);
+	*(uint32_t *)&bitstring[0] = colors;
+	// Set the pixel indices (the error is the same).
+	SetPixelsETC1(info, bitstring, detexErrorLimits <uint32_t>::Max());
+	return error;
+}
+
+// Hybrid search (DETEX_COMPRESS_FLAG_HYBRID). Each candidate covers all 64 table codeword
+// combinations of its base colors and costs about as much as eight regular candidates, so the
+// search schedule is shortened by the same factor. The shortened schedule is kept valid (at
+// least one seed generation and one generation after seeding, see detexCompressTextures()).
+template <uint32_t (*SetPixelsHybrid)(const detexBlockInfo *info, uint8_t *bitstring, uint32_t bound)>
+static double CompressBlockHybridETC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	detexCompressionParameters hybrid_params = *params;
+	hybrid_params.nu_seed_generations = params->nu_seed_generations / 8;
+	if (hybrid_params.nu_seed_generations < 1)
+		hybrid_params.nu_seed_generations = 1;
+	hybrid_params.nu_generations = params->nu_generations / 8;
+	if (hybrid_params.nu_generations <= hybrid_params.nu_seed_generations)
+		hybrid_params.nu_generations = hybrid_params.nu_seed_generations + 1;
+	hybrid_params.nu_stale_generations = params->nu_stale_generations / 8;
+	return detexCompressBlock <uint32_t, 8, AnalyticSeedETC1, SeedETC1, MutateColorsETC1,
+		SetPixelsHybrid>(info, rng, bitstring, &hybrid_params);
+}
+
+double CompressBlockETC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	if (params->flags & DETEX_COMPRESS_FLAG_HYBRID)
+		return CompressBlockHybridETC1 <SetPixelsHybridETC1>(info, rng, bitstring, params);
+	return detexCompressBlock <uint32_t, 8, AnalyticSeedETC1, SeedETC1, MutateETC1,
+		SetPixelsETC1>(info, rng, bitstring, params);
+}
+
+double CompressBlockAnalyticETC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlockAnalytic <uint32_t, 8, AnalyticSeedETC1, SetPixelsETC1>(info, rng, bitstring,
+		params);
+}
+
+#ifdef DETEX_AVX2_KERNELS
+
+// AVX2 version of SetPixelsSIMDETC1(). All sixteen pixels of the block fit in one register per
+// component (rows 0-1 in the low half, rows 2-3 in the high half), and the pixel indices are
+// moved to their bit positions (dy + dx * 4, and 16 bits higher for the MSB) with variable
+// shifts.
+static DETEX_TARGET_AVX2 uint32_t SetPixelsAVX2ETC1(const detexBlockInfo * DETEX_RESTRICT info,
+const int * DETEX_RESTRICT base_color_subblock1, const int * DETEX_RESTRICT base_color_subblock2,
+const int * DETEX_RESTRICT table_codeword, int flip, uint32_t & DETEX_RESTRICT pixel_indices) {
+	const detexBlockPixels *pixels = info->pixels;
+	__m256i m_zero = _mm256_setzero_si256();
+	// The staged pixels of the block in order, rows 0-1 in the low half and rows 2-3 in the
+	// high half.
+	__m256i m_r = _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)pixels->r));
+	__m256i m_g = _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)pixels->g));
+	__m256i m_b = _mm256_cvtepu8_epi16(_mm_load_si128((const __m128i *)pixels->b));
+	// Mask of the pixels that belong to subblock 2.
+	__m256i m_subblock2;
+	if (flip == 0)
+		m_subblock2 = _mm256_setr_epi16(0, 0, -1, -1, 0, 0, -1, -1, 0, 0, -1, -1, 0, 0, -1, -1);
+	else
+		m_subblock2 = _mm256_setr_epi16(0, 0, 0, 0, 0, 0, 0, 0, -1, -1, -1, -1, -1, -1, -1, -1);
+	__m256i m_base_r = _mm256_blendv_epi8(_mm256_set1_epi16(base_color_subblock1[0]),
+		_mm256_set1_epi16(base_color_subblock2[0]), m_subblock2);
+	__m256i m_base_g = _mm256_blendv_epi8(_mm256_set1_epi16(base_color_subblock1[1]),
+		_mm256_set1_epi16(base_color_subblock2[1]), m_subblock2);
+	__m256i m_base_b = _mm256_blendv_epi8(_mm256_set1_epi16(base_color_subblock1[2]),
+		_mm256_set1_epi16(base_color_subblock2[2]), m_subblock2);
+	__m256i m_255 = _mm256_set1_epi16(255);
+	// Errors of rows 0 and 2, and of rows 1 and 3 (one pixel per 32-bit lane).
+	__m256i m_best_error[2];
+	__m256i m_best_pixel_index[2];
+	for (int k = 0; k < 4; k++) {
+		__m256i m_modifier = _mm256_blendv_epi8(
+			_mm256_set1_epi16(modifier_table[table_codeword[0]][k]),
+			_mm256_set1_epi16(modifier_table[table_codeword[1]][k]), m_subblock2);
+		__m256i m_color_r = _mm256_min_epi16(_mm256_max_epi16(
+			_mm256_add_epi16(m_base_r, m_modifier), m_zero), m_255);
+		__m256i m_color_g = _mm256_min_epi16(_mm256_max_epi16(
+			_mm256_add_epi16(m_base_g, m_modifier), m_zero), m_255);
+		__m256i m_color_b = _mm256_min_epi16(_mm256_max_epi16(
+			_mm256_add_epi16(m_base_b, m_modifier), m_zero), m_255);
+		__m256i m_diff_r = _mm256_sub_epi16(m_r, m_color_r);
+		__m256i m_diff_g = _mm256_sub_epi16(m_g, m_color_g);
+		__m256i m_diff_b = _mm256_sub_epi16(m_b, m_color_b);
+		__m256i m_diff_rg = _mm256_unpacklo_epi16(m_diff_r, m_diff_g);
+		__m256i m_diff_b0 = _mm256_unpacklo_epi16(m_diff_b, m_zero);
+		__m256i m_error[2];
+		m_error[0] = _mm256_add_epi32(_mm256_madd_epi16(m_diff_rg, m_diff_rg),
+			_mm256_madd_epi16(m_diff_b0, m_diff_b0));
+		m_diff_rg = _mm256_unpackhi_epi16(m_diff_r, m_diff_g);
+		m_diff_b0 = _mm256_unpackhi_epi16(m_diff_b, m_zero);
+		m_error[1] = _mm256_add_epi32(_mm256_madd_epi16(m_diff_rg, m_diff_rg),
+			_mm256_madd_epi16(m_diff_b0, m_diff_b0));
+		for (int l = 0; l < 2; l++) {
+			if (k == 0) {
+				m_best_error[l] = m_error[l];
+				m_best_pixel_index[l] = m_zero;
+				continue;
+			}
+			// Like the scalar version, keep the first index with the lowest error.
+			__m256i m_cmp = _mm256_cmpgt_epi32(m_best_error[l], m_error[l]);
+			m_best_error[l] = _mm256_min_epi32(m_best_error[l], m_error[l]);
+			m_best_pixel_index[l] = _mm256_blendv_epi8(m_best_pixel_index[l],
+				_mm256_set1_epi32(k), m_cmp);
+		}
+	}
+	__m256i m_error = _mm256_add_epi32(m_best_error[0], m_best_error[1]);
+	__m128i m_error128 = _mm_add_epi32(_mm256_castsi256_si128(m_error),
+		_mm256_extracti128_si256(m_error, 1));
+	m_error128 = _mm_add_epi32(m_error128, _mm_shuffle_epi32(m_error128, 0x4E));
+	m_error128 = _mm_add_epi32(m_error128, _mm_shuffle_epi32(m_error128, 0xB1));
+	// Put the LSB of each index at bit 0 and the MSB at bit 16 of its lane, and shift both to
+	// the position of the pixel.
+	__m256i m_one = _mm256_set1_epi32(1);
+	__m256i m_indices = m_zero;
+	for (int l = 0; l < 2; l++) {
+		__m256i m_bits = _mm256_or_si256(_mm256_and_si256(m_best_pixel_index[l], m_one),
+			_mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(m_best_pixel_index[l], 1),
+			m_one), 16));
+		m_indices = _mm256_or_si256(m_indices, _mm256_sllv_epi32(m_bits,
+			_mm256_setr_epi32(l, l + 4, l + 8, l + 12, l + 2, l + 6, l + 10, l + 14)));
+	}
+	__m128i m_indices128 = _mm_or_si128(_mm256_castsi256_si128(m_indices),
+		_mm256_extracti128_si256(m_indices, 1));
+	m_indices128 = _mm_or_si128(m_indices128, _mm_shuffle_epi32(m_indices128, 0x4E));
+	m_indices128 = _mm_or_si128(m_indices128, _mm_shuffle_epi32(m_indices128, 0xB1));
+	pixel_indices = _mm_cvtsi128_si32(m_indices128);
+	return _mm_cvtsi128_si32(m_error128);
+}
+
+// All pixels are evaluated at once by the AVX2 kernel, so the bound only serves to skip storing
+// the pixel indices of a candidate that is rejected.
+DETEX_TARGET_AVX2 uint32_t SetPixelsETC1AVX2(const detexBlockInfo * DETEX_RESTRICT info,
+uint8_t * DETEX_RESTRICT bitstring, uint32_t bound) {
+	// Decode the two base colors.
+	uint32_t colors = *(uint32_t *)&bitstring[0];
+	int base_color_subblock1[3];
+	int base_color_subblock2[3];
+	int table_codeword[2];
+	if (bitstring[3] & 2)
+		DecodeColorsETC1ModeDifferential(colors, base_color_subblock1, base_color_subblock2, table_codeword);
+	else
+		DecodeColorsETC1ModeIndividual(colors, base_color_subblock1, base_color_subblock2, table_codeword);
+	uint32_t pixel_indices;
+	uint32_t error = SetPixelsAVX2ETC1(info, base_color_subblock1, base_color_subblock2, table_codeword,
+		bitstring[3] & 1, pixel_indices);
+	if (error >= bound)
+		return error;
+	bitstring[4] = pixel_indices >> 24;
+	bitstring[5] = pixel_indices >> 16;
+	bitstring[6] = pixel_indices >> 8;
+	bitstring[7] = pixel_indices;
+	return error;
+}
+
+// AVX2 version of SetPixelsHybridETC1(). The two subblocks are held in the low and high
+// halves of one register per component, so that each table codeword is evaluated for both
+// subblocks at once.
+DETEX_TARGET_AVX2 uint32_t SetPixelsHybridETC1AVX2(const detexBlockInfo * DETEX_RESTRICT info,
+uint8_t * DETEX_RESTRICT bitstring, uint32_t bound) {
+	uint32_t colors = *(uint32_t *)&bitstring[0];
+	int base_color[2][3];
+	int table_codeword[2];
+	if (bitstring[3] & 2)
+		DecodeColorsETC1ModeDifferential(colors, base_color[0], base_color[1], table_codeword);
+	else
+		DecodeColorsETC1ModeIndividual(colors, base_color[0], base_color[1], table_codeword);
+	__m128i m_r128[2], m_g128[2], m_b128[2];
+	LoadSubblockPixelsSIMDETC1(info, bitstring[3] & 1, m_r128, m_g128, m_b128);
+	__m256i m_pixels[3];
+	m_pixels[0] = _mm256_inserti128_si256(_mm256_castsi128_si256(m_r128[0]), m_r128[1], 1);
+	m_pixels[1] = _mm256_inserti128_si256(_mm256_castsi128_si256(m_g128[0]), m_g128[1], 1);
+	m_pixels[2] = _mm256_inserti128_si256(_mm256_castsi128_si256(m_b128[0]), m_b128[1], 1);
+	// The base color of each subblock in its half.
+	__m256i m_base_color[3];
+	for (int c = 0; c < 3; c++)
+		m_base_color[c] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi16(base_color[0][c])),
+			_mm_set1_epi16(base_color[1][c]), 1);
+	__m256i m_zero = _mm256_setzero_si256();
+	__m256i m_255 = _mm256_set1_epi16(255);
+	uint32_t best_error[2] = { detexErrorLimits <uint32_t>::Max(), detexErrorLimits <uint32_t>::Max() };
+	for (int cw = 0; cw < 8; cw++) {
+		__m256i m_best_error[2];
+		m_best_error[0] = _mm256_set1_epi32(INT_MAX);
+		m_best_error[1] = m_best_error[0];
+		for (int j = 0; j < 4; j++) {
+			__m256i m_modifier = _mm256_set1_epi16(modifier_table[cw][j]);
+			__m256i m_diff[3];
+			for (int c = 0; c < 3; c++) {
+				__m256i m_color = _mm256_min_epi16(_mm256_max_epi16(
+					_mm256_add_epi16(m_base_color[c], m_modifier), m_zero), m_255);
+				m_diff[c] = _mm256_sub_epi16(m_pixels[c], m_color);
+			}
+			__m256i m_diff_rg = _mm256_unpacklo_epi16(m_diff[0], m_diff[1]);
+			__m256i m_diff_b0 = _mm256_unpacklo_epi16(m_diff[2], m_zero);
+			__m256i m_error[2];
+			m_error[0] = _mm256_add_epi32(_mm256_madd_epi16(m_diff_rg, m_diff_rg),
+				_mm256_madd_epi16(m_diff_b0, m_diff_b0));
+			m_diff_rg = _mm256_unpackhi_epi16(m_diff[0], m_diff[1]);
+			m_diff_b0 = _mm256_unpackhi_epi16(m_diff[2], m_zero);
+			m_error[1] = _mm256_add_epi32(_mm256_madd_epi16(m_diff_rg, m_diff_rg),
+				_mm256_madd_epi16(m_diff_b0, m_diff_b0));
+			for (int l = 0; l < 2; l++)
+				m_best_error[l] = _mm256_min_epi32(m_best_error[l], m_error[l]);
+		}
+		// Sum the errors of each subblock within its half.
+		__m256i m_error = _mm256_add_epi32(m_best_error[0], m_best_error[1]);
+		m_error = _mm256_add_epi32(m_error, _mm256_shuffle_epi32(m_error, 0x4E));
+		m_error = _mm256_add_epi32(m_error, _mm256_shuffle_epi32(m_error, 0xB1));
+		uint32_t error[2];
+		error[0] = _mm_cvtsi128_si32(_mm256_castsi256_si128(m_error));
+		error[1] = _mm_cvtsi128_si32(_mm256_extracti128_si256(m_error, 1));
+		for (int i = 0; i < 2; i++)
+			if (error[i] < best_error[i]) {
+				best_error[i] = error[i];
+				table_codeword[i] = cw;
+			}
 	}
+	uint32_t error = best_error[0] + best_error[1];
+	if (error >= bound)
+		return error;
+	colors = (colors & 0x03FFFFFF) | (table_codeword[0] << 29) | (table_codeword[1] << 26);
+	*(uint32_t *)&bitstring[0] = colors;
+	// Set the pixel indices (the error is the same).
+	SetPixelsETC1AVX2(info, bitstring, detexErrorLimits <uint32_t>::Max());
+	return error;
+}
+
+double CompressBlockETC1AVX2(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	if (params->flags & DETEX_COMPRESS_FLAG_HYBRID)
+		return CompressBlockHybridETC1 <SetPixelsHybridETC1AVX2>(info, rng, bitstring, params);
+	return detexCompressBlock <uint32_t, 8, AnalyticSeedETC1, SeedETC1, MutateETC1,
+		SetPixelsETC1AVX2>(info, rng, bitstring, params);
 }
 
+#endif
+
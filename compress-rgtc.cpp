@@ -16,10 +16,27 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 */
 
+#include <limits.h>
+#include <float.h>
+#include <math.h>
 #include <dstRandom.h>
+#ifdef __SSE2__
+#define DST_SIMD_MODE_SSE2
+#include <dstSIMD.h>
+#include <immintrin.h>
+#endif
 #include "detex.h"
+#include "compress.h"
 #include "compress-block.h"
 
+// The one-component formats read their component directly from the texture, which has two
+// components per pixel when the components of RGTC2 or SIGNED_RGTC2 are compressed. Return
+// the address of the top-left pixel of the block.
+static DETEX_INLINE_ONLY const uint8_t *GetBlockPixelsRGTC1(const detexBlockInfo * DETEX_RESTRICT info) {
+	const detexTexture *texture = info->texture;
+	return texture->data + (info->y * texture->width + info->x) * info->pixel_size;
+}
+
 void SeedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng,
 uint8_t * DETEX_RESTRICT bitstring) {
 	uint32_t red_values = rng->RandomBits(16);
@@ -32,6 +49,145 @@ uint8_t * DETEX_RESTRICT bitstring) {
 	*(uint16_t *)(bitstring) = red_values;
 }
 
+// Add the value pair (value0, value1) to the candidates when it corresponds to the mode.
+static void AddValuePairRGTC1(int value0, int value1, int mode, uint32_t * DETEX_RESTRICT value_pairs,
+int & DETEX_RESTRICT n) {
+	uint32_t pair = (value0 & 0xFF) | ((value1 & 0xFF) << 8);
+	int m = (pair & 0xFF) <= (pair >> 8);
+	if (mode >= 0 && m != mode)
+		return;
+	for (int i = 0; i < n; i++)
+		if (value_pairs[i] == pair)
+			return;
+	value_pairs[n] = pair;
+	n++;
+}
+
+// Derive candidate value pairs for a block of values in the range low to high from the
+// minimum and maximum of the values and of the inner values (the values other than low and
+// high, with a minimum of high and a maximum of low when there are none). The eight-value
+// interpolation (value0 > value1) is seeded with the minimum and maximum (as is and inset),
+// the six-value interpolation with the minimum and maximum of the inner values, which are not
+// represented by the explicit low and high values.
+static int GetValueRangePairsRGTC1(int min_value, int max_value, int min_inner_value, int max_inner_value,
+int low, int high, int mode, uint32_t * DETEX_RESTRICT value_pairs) {
+	int n = 0;
+	// Eight-value interpolation.
+	if (max_value > min_value) {
+		AddValuePairRGTC1(max_value, min_value, mode, value_pairs, n);
+		int inset = (max_value - min_value) / 16;
+		if (inset > 0)
+			AddValuePairRGTC1(max_value - inset, min_value + inset, mode, value_pairs, n);
+	}
+	else if (max_value < high)
+		AddValuePairRGTC1(max_value + 1, min_value, mode, value_pairs, n);
+	else
+		AddValuePairRGTC1(max_value, min_value - 1, mode, value_pairs, n);
+	// Six-value interpolation.
+	if (max_inner_value >= min_inner_value)
+		AddValuePairRGTC1(min_inner_value, max_inner_value, mode, value_pairs, n);
+	AddValuePairRGTC1(min_value, max_value, mode, value_pairs, n);
+	return n;
+}
+
+// Derive candidate value pairs for a block of 16 values in the range low to high.
+static int GetAnalyticValuePairsRGTC1(const int * DETEX_RESTRICT values, int low, int high, int mode,
+uint32_t * DETEX_RESTRICT value_pairs) {
+	int min_value = high;
+	int max_value = low;
+	int min_inner_value = high;
+	int max_inner_value = low;
+	for (int i = 0; i < 16; i++) {
+		if (values[i] < min_value)
+			min_value = values[i];
+		if (values[i] > max_value)
+			max_value = values[i];
+		if (values[i] != low && values[i] != high) {
+			if (values[i] < min_inner_value)
+				min_inner_value = values[i];
+			if (values[i] > max_inner_value)
+				max_inner_value = values[i];
+		}
+	}
+	return GetValueRangePairsRGTC1(min_value, max_value, min_inner_value, max_inner_value, low, high,
+		mode, value_pairs);
+}
+
+int GetAnalyticValuesRGTC1(const int * DETEX_RESTRICT values, int mode, uint32_t * DETEX_RESTRICT value_pairs) {
+	return GetAnalyticValuePairsRGTC1(values, 0, 255, mode, value_pairs);
+}
+
+static void GetValuesRGTC1(const detexBlockInfo * DETEX_RESTRICT info, int * DETEX_RESTRICT values) {
+	const uint8_t *pix_orig = GetBlockPixelsRGTC1(info) + info->component;
+	int stride_orig = info->texture->width * info->pixel_size;
+	for (int dy = 0; dy < 4; dy++)
+		for (int dx = 0; dx < 4; dx++)
+			values[dy * 4 + dx] = pix_orig[dy * stride_orig + dx * info->pixel_size];
+}
+
+int AnalyticSeedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings) {
+	int values[16];
+	GetValuesRGTC1(info, values);
+	uint32_t value_pairs[4];
+	int n = GetAnalyticValuePairsRGTC1(values, 0, 255, info->mode, value_pairs);
+	for (int i = 0; i < n; i++)
+		*(uint16_t *)&bitstrings[i * 16] = value_pairs[i];
+	return n;
+}
+
+// Try to find an exact encoding for a block of 16 values in the range low to high. This is
+// possible when there are at most two different values apart from low and high, using the
+// six-value interpolation mode in which low and high are represented explicitly.
+static bool EncodeExactValuePairRGTC1(const int * DETEX_RESTRICT values, int low, int high,
+uint8_t * DETEX_RESTRICT bitstring) {
+	int value0 = - 1024;
+	int value1 = - 1024;
+	for (int i = 0; i < 16; i++) {
+		if (values[i] == low || values[i] == high || values[i] == value0 || values[i] == value1)
+			continue;
+		if (value0 == - 1024)
+			value0 = values[i];
+		else if (value1 == - 1024)
+			value1 = values[i];
+		else
+			return false;
+	}
+	if (value0 == - 1024)
+		value0 = low;
+	if (value1 == - 1024)
+		value1 = value0;
+	if (value0 > value1) {
+		int temp = value0;
+		value0 = value1;
+		value1 = temp;
+	}
+	uint64_t pixel_indices = 0;
+	for (int i = 0; i < 16; i++) {
+		uint64_t pixel_index;
+		if (values[i] == value0)
+			pixel_index = 0;
+		else if (values[i] == value1)
+			pixel_index = 1;
+		else if (values[i] == low)
+			pixel_index = 6;
+		else
+			pixel_index = 7;
+		pixel_indices |= pixel_index << (i * 3);
+	}
+	*(uint64_t *)bitstring = (value0 & 0xFF) | ((value1 & 0xFF) << 8) | (pixel_indices << 16);
+	return true;
+}
+
+bool EncodeExactValuesRGTC1(const int * DETEX_RESTRICT values, uint8_t * DETEX_RESTRICT bitstring) {
+	return EncodeExactValuePairRGTC1(values, 0, 255, bitstring);
+}
+
+bool EncodeTrivialRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+	int values[16];
+	GetValuesRGTC1(info, values);
+	return EncodeExactValuesRGTC1(values, bitstring);
+}
+
 static const uint32_t detex_rgtc1_component_mask[6] = {
 	0xFF, 0xFF00
 };
@@ -126,8 +282,8 @@ uint8_t * DETEX_RESTRICT bitstring) {
 }
 
 static DETEX_INLINE_ONLY uint32_t SetPixelXYRGTC1(const uint8_t * DETEX_RESTRICT pix_orig, int stride_orig,
-int dx, int dy, const int * DETEX_RESTRICT red, uint64_t & DETEX_RESTRICT red_pixel_indices) {
-	int red_orig = *(uint8_t *)(pix_orig + dy * stride_orig + dx);
+int pixel_size, int dx, int dy, const int * DETEX_RESTRICT red, uint64_t & DETEX_RESTRICT red_pixel_indices) {
+	int red_orig = *(uint8_t *)(pix_orig + dy * stride_orig + dx * pixel_size);
 	uint32_t best_error = (red_orig - red[0]) * (red_orig - red[0]);
 	int best_pixel_index = 0;
 	for (int i = 1; i < 8; i++) {
@@ -161,44 +317,805 @@ static DETEX_INLINE_ONLY void DecodeRedRGTC1(int *red) {
 	}
 }
 
-uint32_t SetPixelsRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
-	const detexTexture *texture = info->texture;
-	int x = info->x;
-	int y = info->y;
+#ifdef __SSE2__
+
+// Pack sixteen 3-bit pixel indices, one per byte of m_pixel_index, into the 48-bit index
+// field: combine byte pairs into 6 bits per 16-bit lane, 16-bit pairs into 12 bits per
+// 32-bit lane with _mm_madd_epi16() and 32-bit pairs into 24 bits per 64-bit lane.
+static DETEX_INLINE_ONLY uint64_t PackPixelIndicesRGTC1(__simd128_int m_pixel_index) {
+	__simd128_int m_indices = simd128_or_int(simd128_and_int(m_pixel_index, _mm_set1_epi16(0x7)),
+		_mm_srli_epi16(m_pixel_index, 5));
+	m_indices = _mm_madd_epi16(m_indices, simd128_set_same_int32(0x00400001));
+	m_indices = simd128_and_int(simd128_or_int(m_indices, _mm_srli_epi64(m_indices, 20)),
+		_mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF));
+	return (uint32_t)simd128_get_int32(m_indices) |
+		((uint64_t)(uint32_t)simd128_get_int32(_mm_shuffle_epi32(m_indices, 0x02)) << 24);
+}
+
+// Return the sum of the four 32-bit values in m_sum.
+static DETEX_INLINE_ONLY int GetSumSIMD32(__simd128_int m_sum) {
+	m_sum = simd128_add_int32(m_sum, _mm_shuffle_epi32(m_sum, 0x4E));
+	m_sum = simd128_add_int32(m_sum, _mm_shuffle_epi32(m_sum, 0xB1));
+	return simd128_get_int32(m_sum);
+}
+
+// Return the sum of the products of the sixteen 8-bit values in m_a and m_b.
+static DETEX_INLINE_ONLY int GetSumOfProductsSIMD8(__simd128_int m_a, __simd128_int m_b) {
+	__simd128_int m_zero = simd128_set_zero_int();
+	return GetSumSIMD32(simd128_add_int32(
+		_mm_madd_epi16(_mm_unpacklo_epi8(m_a, m_zero), _mm_unpacklo_epi8(m_b, m_zero)),
+		_mm_madd_epi16(_mm_unpackhi_epi8(m_a, m_zero), _mm_unpackhi_epi8(m_b, m_zero))));
+}
+
+// Return the sum of the squares of the sixteen 8-bit values in m_diff.
+static DETEX_INLINE_ONLY uint32_t GetSumOfSquaresSIMD8(__simd128_int m_diff) {
+	return GetSumOfProductsSIMD8(m_diff, m_diff);
+}
+
+// Select the first palette value with the lowest error for each of the sixteen 8-bit values
+// in m_values, using unsigned saturating byte arithmetic: the absolute difference orders the
+// palette values the same way as the squared error, so the selection only needs byte compares
+// and masks. Returns the error and sets the pixel index of each value (one per byte).
+static DETEX_INLINE_ONLY uint32_t GetErrorSIMD8Levels(__simd128_int m_values, const int * DETEX_RESTRICT palette,
+__simd128_int & DETEX_RESTRICT m_best_pixel_index) {
+	__simd128_int m_palette_value = _mm_set1_epi8(palette[0]);
+	__simd128_int m_best_diff = simd128_or_int(_mm_subs_epu8(m_values, m_palette_value),
+		_mm_subs_epu8(m_palette_value, m_values));
+	m_best_pixel_index = simd128_set_zero_int();
+	for (int k = 1; k < 8; k++) {
+		m_palette_value = _mm_set1_epi8(palette[k]);
+		__simd128_int m_diff = simd128_or_int(_mm_subs_epu8(m_values, m_palette_value),
+			_mm_subs_epu8(m_palette_value, m_values));
+		// Like the scalar version, keep the first value with the lowest error (the mask is
+		// set where the new difference is not lower).
+		__simd128_int m_not_lower = _mm_cmpeq_epi8(_mm_max_epu8(m_diff, m_best_diff), m_diff);
+		m_best_diff = _mm_min_epu8(m_diff, m_best_diff);
+		m_best_pixel_index = simd128_or_int(simd128_and_int(m_not_lower, m_best_pixel_index),
+			simd128_andnot_int(m_not_lower, _mm_set1_epi8(k)));
+	}
+	return GetSumOfSquaresSIMD8(m_best_diff);
+}
+
+// Pixel-parallel kernel for an eight-level palette of 8-bit values, shared by RGTC1 and the
+// alpha of BC3. The sixteen values of the block (byte component of pixels of 1, 2 or 4 bytes,
+// such as the red or green byte of RG8 pixels or the alpha byte of RGBA8 pixels) are held in
+// one register and compared against each palette value at once. Returns the error and sets
+// the 48 bits of pixel indices.
+uint32_t SetPixelIndicesSIMD8Levels(const uint8_t * DETEX_RESTRICT pix_orig, int stride_orig,
+int pixel_size, int component, const int * DETEX_RESTRICT palette, uint64_t & DETEX_RESTRICT pixel_indices) {
+	__simd128_int m_values;
+	if (pixel_size == 1)
+		m_values = _mm_set_epi32(*(uint32_t *)(pix_orig + 3 * stride_orig),
+			*(uint32_t *)(pix_orig + 2 * stride_orig), *(uint32_t *)(pix_orig + stride_orig),
+			*(uint32_t *)pix_orig);
+	else if (pixel_size == 2) {
+		// Isolate the component in the low byte of each 16-bit lane.
+		__simd128_int m_row[4];
+		for (int dy = 0; dy < 4; dy++)
+			m_row[dy] = _mm_loadl_epi64((const __m128i *)(pix_orig + dy * stride_orig));
+		__simd128_int m_rows01 = _mm_unpacklo_epi64(m_row[0], m_row[1]);
+		__simd128_int m_rows23 = _mm_unpacklo_epi64(m_row[2], m_row[3]);
+		__simd128_int m_shift_left = _mm_cvtsi32_si128(8 - component * 8);
+		m_rows01 = _mm_srli_epi16(_mm_sll_epi16(m_rows01, m_shift_left), 8);
+		m_rows23 = _mm_srli_epi16(_mm_sll_epi16(m_rows23, m_shift_left), 8);
+		m_values = _mm_packus_epi16(m_rows01, m_rows23);
+	}
+	else {
+		// Isolate the component in the low byte of each 32-bit lane.
+		__simd128_int m_shift_left = _mm_cvtsi32_si128(24 - component * 8);
+		__simd128_int m_row[4];
+		for (int dy = 0; dy < 4; dy++)
+			m_row[dy] = _mm_srli_epi32(_mm_sll_epi32(_mm_loadu_si128(
+				(const __m128i *)(pix_orig + dy * stride_orig)), m_shift_left), 24);
+		m_values = _mm_packus_epi16(_mm_packs_epi32(m_row[0], m_row[1]),
+			_mm_packs_epi32(m_row[2], m_row[3]));
+	}
+	__simd128_int m_best_pixel_index;
+	uint32_t error = GetErrorSIMD8Levels(m_values, palette, m_best_pixel_index);
+	pixel_indices = PackPixelIndicesRGTC1(m_best_pixel_index);
+	return error;
+}
+
+#endif
+
+uint32_t SetPixelsRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring,
+uint32_t bound) {
 	int red[8];
 	red[0] = bitstring[0];
 	red[1] = bitstring[1];
 	DecodeRedRGTC1(red);
-	uint8_t *pix_orig = texture->data + y * texture->width + x;
-	int stride_orig = texture->width;
+	const uint8_t *pix_orig = GetBlockPixelsRGTC1(info);
+	int pixel_size = info->pixel_size;
+	int stride_orig = info->texture->width * pixel_size;
 	uint64_t red_pixel_indices = 0;
-	uint32_t error = SetPixelXYRGTC1(pix_orig, stride_orig, 0, 0, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 1, 0, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 2, 0, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 3, 0, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 0, 1, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 1, 1, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 2, 1, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 3, 1, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 0, 2, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 1, 2, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 2, 2, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 3, 2, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 0, 3, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 1, 3, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 2, 3, red, red_pixel_indices);
-	error += SetPixelXYRGTC1(pix_orig, stride_orig, 3, 3, red, red_pixel_indices);
+#ifdef __SSE2__
+	// All pixels are evaluated at once, so the bound is not used.
+	uint32_t error = SetPixelIndicesSIMD8Levels(pix_orig, stride_orig, pixel_size, info->component, red,
+		red_pixel_indices);
+#else
+	pix_orig += info->component;
+	uint32_t error = SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 0, 0, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 1, 0, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 2, 0, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 3, 0, red, red_pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 0, 1, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 1, 1, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 2, 1, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 3, 1, red, red_pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 0, 2, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 1, 2, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 2, 2, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 3, 2, red, red_pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 0, 3, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 1, 3, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 2, 3, red, red_pixel_indices);
+	error += SetPixelXYRGTC1(pix_orig, stride_orig, pixel_size, 3, 3, red, red_pixel_indices);
+#endif
 	*(uint64_t *)bitstring = *(uint16_t *)bitstring | (red_pixel_indices << 16);
 	return error;
 }
 
+// Set the pixel indices of DETEX_BATCH_SIZE (four) candidate bitstrings, 16 bytes apart, and
+// store their comparison error values, with each candidate in one 32-bit lane.
+void SetPixelsBatchRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings,
+uint32_t bound, uint32_t * DETEX_RESTRICT errors) {
+#ifdef __SSE2__
+	// Decode the values of the candidates into SoA layout: element k * 4 + i holds value k
+	// of candidate i.
+	int palette[32] DST_ALIGNED(16);
+	for (int i = 0; i < 4; i++) {
+		int red[8];
+		red[0] = bitstrings[i * 16];
+		red[1] = bitstrings[i * 16 + 1];
+		DecodeRedRGTC1(red);
+		for (int k = 0; k < 8; k++)
+			palette[k * 4 + i] = red[k];
+	}
+	__simd128_int m_palette[8];
+	for (int k = 0; k < 8; k++)
+		m_palette[k] = simd128_load_int(&palette[k * 4]);
+	const uint8_t *pix_orig = GetBlockPixelsRGTC1(info) + info->component;
+	int pixel_size = info->pixel_size;
+	int stride_orig = info->texture->width * pixel_size;
+	__simd128_int low_int16_mask = simd128_set_same_int32(0x0000FFFF);
+	// The errors are far below INT_MAX, so the signed comparison with the bound is exact.
+	__simd128_int m_bound = simd128_set_same_int32(bound > INT_MAX ? INT_MAX : bound);
+	__simd128_int m_error = simd128_set_zero_int();
+	// The 48 bits of pixel indices are collected in two parts, pixels 0 to 9 and 10 to 15.
+	__simd128_int m_pixel_indices_low = simd128_set_zero_int();
+	__simd128_int m_pixel_indices_high = simd128_set_zero_int();
+	for (int i = 0; i < 16; i++) {
+		__simd128_int m_red_orig = simd128_set_same_int32(
+			pix_orig[(i / 4) * stride_orig + (i % 4) * pixel_size]);
+		__simd128_int m_best_error;
+		__simd128_int m_best_pixel_index = simd128_set_zero_int();
+		for (int k = 0; k < 8; k++) {
+			// The squared differences fit in the low 16 bits of each lane.
+			__simd128_int m_diff = simd128_sub_int32(m_red_orig, m_palette[k]);
+			__simd128_int m_pixel_error = simd128_and_int(_mm_mullo_epi16(m_diff, m_diff),
+				low_int16_mask);
+			if (k == 0) {
+				m_best_error = m_pixel_error;
+				continue;
+			}
+			// Like the scalar version, keep the first value with the lowest error.
+			__simd128_int m_cmp = _mm_cmplt_epi32(m_pixel_error, m_best_error);
+			m_best_error = simd128_or_int(
+				simd128_andnot_int(m_cmp, m_best_error),
+				simd128_and_int(m_cmp, m_pixel_error));
+			m_best_pixel_index = simd128_or_int(
+				simd128_andnot_int(m_cmp, m_best_pixel_index),
+				simd128_and_int(m_cmp, simd128_set_same_int32(k)));
+		}
+		m_error = simd128_add_int32(m_error, m_best_error);
+		if (i < 10)
+			m_pixel_indices_low = simd128_or_int(m_pixel_indices_low,
+				_mm_sll_epi32(m_best_pixel_index, _mm_cvtsi32_si128(i * 3)));
+		else
+			m_pixel_indices_high = simd128_or_int(m_pixel_indices_high,
+				_mm_sll_epi32(m_best_pixel_index, _mm_cvtsi32_si128((i - 10) * 3)));
+		// After each row, stop when the error of every candidate has reached the bound.
+		if ((i & 3) == 3 && i < 15 &&
+		_mm_movemask_epi8(_mm_cmplt_epi32(m_error, m_bound)) == 0) {
+			_mm_storeu_si128((__m128i *)errors, m_error);
+			return;
+		}
+	}
+	uint32_t pixel_indices_low[4];
+	uint32_t pixel_indices_high[4];
+	_mm_storeu_si128((__m128i *)errors, m_error);
+	_mm_storeu_si128((__m128i *)pixel_indices_low, m_pixel_indices_low);
+	_mm_storeu_si128((__m128i *)pixel_indices_high, m_pixel_indices_high);
+	for (int i = 0; i < 4; i++) {
+		uint64_t red_pixel_indices = pixel_indices_low[i] | ((uint64_t)pixel_indices_high[i] << 30);
+		uint8_t *bitstring = bitstrings + i * 16;
+		*(uint64_t *)bitstring = *(uint16_t *)bitstring | (red_pixel_indices << 16);
+	}
+#else
+	for (int i = 0; i < DETEX_BATCH_SIZE; i++)
+		errors[i] = SetPixelsRGTC1(info, &bitstrings[i * 16], bound);
+#endif
+}
+
+double CompressBlockRGTC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlockBatched <uint32_t, 8, AnalyticSeedRGTC1, SeedRGTC1, MutateRGTC1,
+		SetPixelsBatchRGTC1>(info, rng, bitstring, params);
+}
+
+#ifdef DETEX_AVX2_KERNELS
+
+// AVX2 version of SetPixelsBatchRGTC1(). The low and high halves of each register hold the
+// four candidates for pixel i and pixel i + 8 of the block. Shift counts of 32 or more, which
+// clear the lane, route the index of each pixel to the right part of the index bits.
+DETEX_TARGET_AVX2 void SetPixelsBatchRGTC1AVX2(const detexBlockInfo * DETEX_RESTRICT info,
+uint8_t * DETEX_RESTRICT bitstrings, uint32_t bound, uint32_t * DETEX_RESTRICT errors) {
+	int palette[32] DST_ALIGNED(16);
+	for (int i = 0; i < 4; i++) {
+		int red[8];
+		red[0] = bitstrings[i * 16];
+		red[1] = bitstrings[i * 16 + 1];
+		DecodeRedRGTC1(red);
+		for (int k = 0; k < 8; k++)
+			palette[k * 4 + i] = red[k];
+	}
+	__m256i m_palette[8];
+	for (int k = 0; k < 8; k++) {
+		__m128i m_red = _mm_load_si128((const __m128i *)&palette[k * 4]);
+		m_palette[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(m_red), m_red, 1);
+	}
+	const uint8_t *pix_orig = GetBlockPixelsRGTC1(info) + info->component;
+	int pixel_size = info->pixel_size;
+	int stride_orig = info->texture->width * pixel_size;
+	__m256i m_low_int16_mask = _mm256_set1_epi32(0x0000FFFF);
+	__m128i m_bound = _mm_set1_epi32(bound > INT_MAX ? INT_MAX : bound);
+	__m256i m_error = _mm256_setzero_si256();
+	// The 48 bits of pixel indices are collected in two parts, pixels 0 to 9 and 10 to 15.
+	__m256i m_pixel_indices_low = _mm256_setzero_si256();
+	__m256i m_pixel_indices_high = _mm256_setzero_si256();
+	for (int i = 0; i < 8; i++) {
+		int red0 = pix_orig[(i / 4) * stride_orig + (i % 4) * pixel_size];
+		int red1 = pix_orig[(i / 4 + 2) * stride_orig + (i % 4) * pixel_size];
+		__m256i m_red_orig = _mm256_setr_epi32(red0, red0, red0, red0, red1, red1, red1, red1);
+		__m256i m_best_error;
+		__m256i m_best_pixel_index = _mm256_setzero_si256();
+		for (int k = 0; k < 8; k++) {
+			__m256i m_diff = _mm256_sub_epi32(m_red_orig, m_palette[k]);
+			__m256i m_pixel_error = _mm256_and_si256(_mm256_mullo_epi16(m_diff, m_diff),
+				m_low_int16_mask);
+			if (k == 0) {
+				m_best_error = m_pixel_error;
+				continue;
+			}
+			// Like the scalar version, keep the first value with the lowest error.
+			__m256i m_cmp = _mm256_cmpgt_epi32(m_best_error, m_pixel_error);
+			m_best_error = _mm256_min_epi32(m_best_error, m_pixel_error);
+			m_best_pixel_index = _mm256_blendv_epi8(m_best_pixel_index, _mm256_set1_epi32(k), m_cmp);
+		}
+		m_error = _mm256_add_epi32(m_error, m_best_error);
+		// Pixel i (0 to 7) always goes to the low part; pixel i + 8 goes to the low part for
+		// pixels 8 and 9 and to the high part otherwise.
+		int shift_low1 = i + 8 < 10 ? (i + 8) * 3 : 32;
+		int shift_high1 = i + 8 < 10 ? 32 : (i - 2) * 3;
+		m_pixel_indices_low = _mm256_or_si256(m_pixel_indices_low, _mm256_sllv_epi32(m_best_pixel_index,
+			_mm256_setr_epi32(i * 3, i * 3, i * 3, i * 3, shift_low1, shift_low1, shift_low1, shift_low1)));
+		m_pixel_indices_high = _mm256_or_si256(m_pixel_indices_high, _mm256_sllv_epi32(m_best_pixel_index,
+			_mm256_setr_epi32(32, 32, 32, 32, shift_high1, shift_high1, shift_high1, shift_high1)));
+		// After rows 0 and 2, stop when the error of every candidate has reached the bound.
+		if (i == 3) {
+			__m128i m_partial_error = _mm_add_epi32(_mm256_castsi256_si128(m_error),
+				_mm256_extracti128_si256(m_error, 1));
+			if (_mm_movemask_epi8(_mm_cmplt_epi32(m_partial_error, m_bound)) == 0) {
+				_mm_storeu_si128((__m128i *)errors, m_partial_error);
+				return;
+			}
+		}
+	}
+	uint32_t pixel_indices_low[4];
+	uint32_t pixel_indices_high[4];
+	_mm_storeu_si128((__m128i *)errors, _mm_add_epi32(_mm256_castsi256_si128(m_error),
+		_mm256_extracti128_si256(m_error, 1)));
+	_mm_storeu_si128((__m128i *)pixel_indices_low, _mm_or_si128(
+		_mm256_castsi256_si128(m_pixel_indices_low), _mm256_extracti128_si256(m_pixel_indices_low, 1)));
+	_mm_storeu_si128((__m128i *)pixel_indices_high, _mm_or_si128(
+		_mm256_castsi256_si128(m_pixel_indices_high), _mm256_extracti128_si256(m_pixel_indices_high, 1)));
+	for (int i = 0; i < 4; i++) {
+		uint64_t red_pixel_indices = pixel_indices_low[i] | ((uint64_t)pixel_indices_high[i] << 30);
+		uint8_t *bitstring = bitstrings + i * 16;
+		*(uint64_t *)bitstring = *(uint16_t *)bitstring | (red_pixel_indices << 16);
+	}
+}
+
+double CompressBlockRGTC1AVX2(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlockBatched <uint32_t, 8, AnalyticSeedRGTC1, SeedRGTC1, MutateRGTC1,
+		SetPixelsBatchRGTC1AVX2>(info, rng, bitstring, params);
+}
+
+#endif
+
+// Lower bounds of the error of a block of 16 values when at most n palette values are used
+// (n = 1 to 8): the error of the optimal n-level quantization of the values with unconstrained
+// levels. The optimal levels divide the sorted values into contiguous groups, so the errors
+// are calculated by dynamic programming over the sorted values.
+static void GetQuantizationErrorBoundsRGTC1(const int * DETEX_RESTRICT values,
+uint32_t * DETEX_RESTRICT error_bound) {
+	int sorted_values[16];
+	for (int i = 0; i < 16; i++) {
+		int j = i;
+		for (; j > 0 && sorted_values[j - 1] > values[i]; j--)
+			sorted_values[j] = sorted_values[j - 1];
+		sorted_values[j] = values[i];
+	}
+	int sum[17];
+	int sum_squares[17];
+	sum[0] = 0;
+	sum_squares[0] = 0;
+	for (int i = 0; i < 16; i++) {
+		sum[i + 1] = sum[i] + sorted_values[i];
+		sum_squares[i + 1] = sum_squares[i] + sorted_values[i] * sorted_values[i];
+	}
+	// group_error[i][j] is the error of the values i to j - 1 for the level at their mean.
+	double group_error[16][17];
+	for (int i = 0; i < 16; i++)
+		for (int j = i + 1; j <= 16; j++) {
+			int s = sum[j] - sum[i];
+			group_error[i][j] = (sum_squares[j] - sum_squares[i]) - (double)s * s / (j - i);
+		}
+	// error[j] is the lowest error of the first j values for the current number of levels.
+	double error[17];
+	for (int j = 1; j <= 16; j++)
+		error[j] = group_error[0][j];
+	error_bound[1] = (uint32_t)error[16];
+	for (int n = 2; n <= 8; n++) {
+		for (int j = 16; j >= n; j--)
+			for (int i = n - 1; i < j; i++)
+				if (error[i] + group_error[i][j] < error[j])
+					error[j] = error[i] + group_error[i][j];
+		// Rounding down keeps the bound at or below the (integer) error of any encoding.
+		error_bound[n] = (uint32_t)error[16];
+	}
+}
+
+#ifdef __SSE2__
+// Load 16 values (0 to 255) into the bytes of a register.
+static DETEX_INLINE_ONLY __simd128_int LoadValuesSIMD8(const int * DETEX_RESTRICT values) {
+	return _mm_packus_epi16(
+		_mm_packs_epi32(_mm_loadu_si128((const __m128i *)values),
+			_mm_loadu_si128((const __m128i *)(values + 4))),
+		_mm_packs_epi32(_mm_loadu_si128((const __m128i *)(values + 8)),
+			_mm_loadu_si128((const __m128i *)(values + 12))));
+}
+
+// Return the minimum and maximum of the sixteen 8-bit values in m_values.
+static DETEX_INLINE_ONLY int GetMinimumSIMD8(__simd128_int m_values) {
+	m_values = _mm_min_epu8(m_values, _mm_srli_si128(m_values, 8));
+	m_values = _mm_min_epu8(m_values, _mm_srli_si128(m_values, 4));
+	m_values = _mm_min_epu8(m_values, _mm_srli_si128(m_values, 2));
+	m_values = _mm_min_epu8(m_values, _mm_srli_si128(m_values, 1));
+	return simd128_get_int32(m_values) & 0xFF;
+}
+
+static DETEX_INLINE_ONLY int GetMaximumSIMD8(__simd128_int m_values) {
+	m_values = _mm_max_epu8(m_values, _mm_srli_si128(m_values, 8));
+	m_values = _mm_max_epu8(m_values, _mm_srli_si128(m_values, 4));
+	m_values = _mm_max_epu8(m_values, _mm_srli_si128(m_values, 2));
+	m_values = _mm_max_epu8(m_values, _mm_srli_si128(m_values, 1));
+	return simd128_get_int32(m_values) & 0xFF;
+}
+#endif
+
+// Set the pixel indices of 16 values for the RGTC1 value pair, packed in the same way as by
+// SetPixelsRGTC1(), and return the error.
+#ifdef __SSE2__
+static DETEX_INLINE_ONLY uint32_t SetValuePixelIndicesRGTC1(__simd128_int m_values, int value0, int value1,
+uint64_t & DETEX_RESTRICT pixel_indices) {
+	int red[8];
+	red[0] = value0;
+	red[1] = value1;
+	DecodeRedRGTC1(red);
+	__simd128_int m_pixel_index;
+	uint32_t error = GetErrorSIMD8Levels(m_values, red, m_pixel_index);
+	pixel_indices = PackPixelIndicesRGTC1(m_pixel_index);
+	return error;
+}
+#else
+static DETEX_INLINE_ONLY uint32_t SetValuePixelIndicesRGTC1(const int * DETEX_RESTRICT values, int value0,
+int value1, uint64_t & DETEX_RESTRICT pixel_indices) {
+	int red[8];
+	red[0] = value0;
+	red[1] = value1;
+	DecodeRedRGTC1(red);
+	uint32_t error = 0;
+	pixel_indices = 0;
+	for (int i = 0; i < 16; i++) {
+		uint32_t best_pixel_error = UINT_MAX;
+		int best_pixel_index = 0;
+		for (int k = 0; k < 8; k++) {
+			uint32_t e = (values[i] - red[k]) * (values[i] - red[k]);
+			if (e < best_pixel_error) {
+				best_pixel_error = e;
+				best_pixel_index = k;
+			}
+		}
+		error += best_pixel_error;
+		pixel_indices |= (uint64_t)best_pixel_index << (i * 3);
+	}
+	return error;
+}
+#endif
+
+// Return the error of the values for the RGTC1 value pair, evaluating all values at once
+// when SSE2 is available. Without SSE2, the evaluation stops when the error reaches bound.
+// GetIntervalErrorBoundRGTC1() returns a lower bound of the error of the value pairs with
+// the lower value low and the higher value high: the error of the values outside of the
+// interval, of which the distance to the palette is at least the distance to the interval,
+// or, in mode 1, the distance to 0 or 255 (extreme_distance) when that is smaller.
+#ifdef __SSE2__
+static DETEX_INLINE_ONLY uint32_t GetValuePairErrorRGTC1(__simd128_int m_values, int value0, int value1) {
+	int red[8];
+	red[0] = value0;
+	red[1] = value1;
+	DecodeRedRGTC1(red);
+	__simd128_int m_pixel_index;
+	return GetErrorSIMD8Levels(m_values, red, m_pixel_index);
+}
+
+static DETEX_INLINE_ONLY uint32_t GetIntervalErrorBoundRGTC1(__simd128_int m_values,
+__simd128_int m_extreme_distance, int low, int high) {
+	__simd128_int m_distance = simd128_or_int(_mm_subs_epu8(_mm_set1_epi8(low), m_values),
+		_mm_subs_epu8(m_values, _mm_set1_epi8(high)));
+	return GetSumOfSquaresSIMD8(_mm_min_epu8(m_distance, m_extreme_distance));
+}
+#else
+static DETEX_INLINE_ONLY uint32_t GetIntervalErrorBoundRGTC1(const int * DETEX_RESTRICT values,
+const int * DETEX_RESTRICT extreme_distance, int low, int high) {
+	uint32_t error = 0;
+	for (int i = 0; i < 16; i++) {
+		int distance = values[i] < low ? low - values[i] : (values[i] > high ? values[i] - high : 0);
+		if (extreme_distance[i] < distance)
+			distance = extreme_distance[i];
+		error += distance * distance;
+	}
+	return error;
+}
+
+static DETEX_INLINE_ONLY uint32_t GetValuePairErrorRGTC1(const int * DETEX_RESTRICT values, int value0,
+int value1, uint32_t bound) {
+	int red[8];
+	red[0] = value0;
+	red[1] = value1;
+	DecodeRedRGTC1(red);
+	uint32_t error = 0;
+	for (int i = 0; i < 16; i++) {
+		uint32_t best_error = UINT_MAX;
+		for (int k = 0; k < 8; k++) {
+			uint32_t e = (values[i] - red[k]) * (values[i] - red[k]);
+			if (e < best_error)
+				best_error = e;
+		}
+		error += best_error;
+		if ((i & 3) == 3 && error >= bound)
+			break;
+	}
+	return error;
+}
+#endif
+
+// Find the optimal RGTC1 encoding of 16 values (in mode, or in both modes when mode is -1),
+// searching all value pairs that can improve on the best encoding found so far, starting
+// with the analytic candidates. With the best error E, every value of an improving encoding
+// lies within a distance r (the largest r with r * r < E) of the palette, which limits the
+// lower and higher of the two values, and the values of the palette that can be used for
+// the block (within r of a value, and at most one below and one above the range of the
+// values) are limited by the spacing of the palette, which must leave an error below E for
+// the optimal quantization with that many levels. Returns the error and stores the encoding
+// (the eight bytes of an RGTC1 block or of the alpha of a BC3 block) in bitstring.
+uint32_t CompressValuesExhaustiveRGTC1(const int * DETEX_RESTRICT values, int mode,
+uint8_t * DETEX_RESTRICT bitstring) {
+	int min_value = 255;
+	int max_value = 0;
+	for (int i = 0; i < 16; i++) {
+		if (values[i] < min_value)
+			min_value = values[i];
+		if (values[i] > max_value)
+			max_value = values[i];
+	}
+	int range = max_value - min_value;
+	uint32_t error_bound[9];
+	GetQuantizationErrorBoundsRGTC1(values, error_bound);
+#ifdef __SSE2__
+	__simd128_int m_values = LoadValuesSIMD8(values);
+	__simd128_int m_extreme_distance[2];
+	m_extreme_distance[0] = _mm_set1_epi8(0xFF);
+	m_extreme_distance[1] = _mm_min_epu8(m_values, _mm_xor_si128(m_values, m_extreme_distance[0]));
+#define GET_VALUE_PAIR_ERROR(value0, value1) GetValuePairErrorRGTC1(m_values, value0, value1)
+#define GET_INTERVAL_ERROR_BOUND(m, low, high) GetIntervalErrorBoundRGTC1(m_values, \
+	m_extreme_distance[m], low, high)
+#else
+	int extreme_distance[2][16];
+	for (int i = 0; i < 16; i++) {
+		extreme_distance[0][i] = 255;
+		extreme_distance[1][i] = values[i] < 255 - values[i] ? values[i] : 255 - values[i];
+	}
+#define GET_VALUE_PAIR_ERROR(value0, value1) GetValuePairErrorRGTC1(values, value0, value1, best_error)
+#define GET_INTERVAL_ERROR_BOUND(m, low, high) GetIntervalErrorBoundRGTC1(values, \
+	extreme_distance[m], low, high)
+#endif
+	uint32_t best_error = UINT_MAX;
+	int best_value0 = 0;
+	int best_value1 = 0;
+	uint32_t value_pairs[4];
+	int n = GetAnalyticValuePairsRGTC1(values, 0, 255, mode, value_pairs);
+	for (int i = 0; i < n; i++) {
+		int value0 = value_pairs[i] & 0xFF;
+		int value1 = value_pairs[i] >> 8;
+		uint32_t error = GET_VALUE_PAIR_ERROR(value0, value1);
+		if (error < best_error) {
+			best_error = error;
+			best_value0 = value0;
+			best_value1 = value1;
+		}
+	}
+	// Mode 0 (value0 > value1) interpolates eight values between the two values, mode 1
+	// (value0 <= value1) interpolates six values and adds 0 and 255.
+	for (int m = 0; m < 2; m++) {
+		if (mode >= 0 && m != mode)
+			continue;
+		for (int width = 1 - m; width < 256 && best_error > 0; width++) {
+			int r = (int)sqrt((double)(best_error - 1));
+			while (r * r >= (int)best_error)
+				r--;
+			while ((r + 1) * (r + 1) < (int)best_error)
+				r++;
+			int gap = m == 0 ? width / 7 : width / 5;
+			if (gap > 0) {
+				// Bound the number of palette values that can be used.
+				int nu_levels = range / gap + 3;
+				int nu_window_levels = (range + 2 * r) / gap + 1;
+				if (m == 1) {
+					nu_levels += (min_value == 0) + (max_value == 255);
+					nu_window_levels += (min_value <= r) + (max_value >= 255 - r);
+				}
+				if (nu_window_levels < nu_levels)
+					nu_levels = nu_window_levels;
+				if (nu_levels < 8 && error_bound[nu_levels] >= best_error)
+					continue;
+			}
+			// Values that are further than r from the extremes must be within r of the
+			// interpolated values.
+			int low_min = 255;
+			int low_max = 0;
+			if (m == 0) {
+				low_min = max_value - r - width;
+				low_max = min_value + r;
+			}
+			else {
+				int inner_min = 255;
+				int inner_max = 0;
+				for (int i = 0; i < 16; i++)
+					if (values[i] > r && values[i] < 255 - r) {
+						if (values[i] < inner_min)
+							inner_min = values[i];
+						if (values[i] > inner_max)
+							inner_max = values[i];
+					}
+				if (inner_min > inner_max) {
+					low_min = 0;
+					low_max = 255;
+				}
+				else {
+					low_min = inner_max - r - width;
+					low_max = inner_min + r;
+				}
+			}
+			if (low_min < 0)
+				low_min = 0;
+			if (low_max > 255 - width)
+				low_max = 255 - width;
+			for (int low = low_min; low <= low_max; low++) {
+				if (GET_INTERVAL_ERROR_BOUND(m, low, low + width) >= best_error)
+					continue;
+				int value0 = m == 0 ? low + width : low;
+				int value1 = m == 0 ? low : low + width;
+				uint32_t error = GET_VALUE_PAIR_ERROR(value0, value1);
+				if (error < best_error) {
+					best_error = error;
+					best_value0 = value0;
+					best_value1 = value1;
+				}
+			}
+		}
+	}
+#undef GET_VALUE_PAIR_ERROR
+#undef GET_INTERVAL_ERROR_BOUND
+	uint64_t red_pixel_indices;
+#ifdef __SSE2__
+	SetValuePixelIndicesRGTC1(m_values, best_value0, best_value1, red_pixel_indices);
+#else
+	SetValuePixelIndicesRGTC1(values, best_value0, best_value1, red_pixel_indices);
+#endif
+	*(uint64_t *)bitstring = best_value0 | (best_value1 << 8) | (red_pixel_indices << 16);
+	return best_error;
+}
+
+double CompressBlockExhaustiveRGTC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	int values[16];
+	GetValuesRGTC1(info, values);
+	uint32_t error = CompressValuesExhaustiveRGTC1(values, info->mode, bitstring);
+	return sqrt((double)error / 16.0d);
+}
+
+// Weight of value0 in each palette value of RGTC1 in mode 0 and 1, in units of 1 / 7 and
+// 1 / 5 respectively (value1 has the remaining weight). The values 0 and 255 of mode 1 do not
+// depend on the value pair and have no weight.
+static const uint8_t detex_rgtc1_value0_weight[2][8] = {
+	{ 7, 0, 6, 5, 4, 3, 2, 1 },
+	{ 5, 0, 4, 3, 2, 1, 0, 0 }
+};
+
+// Solve the least-squares fit of the value pair of the mode, given the sums over the pixels
+// of the products of the weights of value0 (w) and value1 (v) and of the values. Returns false
+// when the fit is undetermined or does not correspond to the mode.
+static bool SolveValuePairRGTC1(int mode, int sum_ww, int sum_wv, int sum_vv, int sum_w_value,
+int sum_v_value, int & DETEX_RESTRICT value0, int & DETEX_RESTRICT value1) {
+	int d = mode == 0 ? 7 : 5;
+	int det = sum_ww * sum_vv - sum_wv * sum_wv;
+	if (det == 0)
+		return false;
+	// Round the solutions of the normal equations to the nearest integer, clamped to 0 to 255
+	// (det is positive).
+	int numerator0 = d * (sum_w_value * sum_vv - sum_wv * sum_v_value);
+	int numerator1 = d * (sum_ww * sum_v_value - sum_wv * sum_w_value);
+	value0 = numerator0 <= 0 ? 0 : (2 * numerator0 + det) / (2 * det);
+	value1 = numerator1 <= 0 ? 0 : (2 * numerator1 + det) / (2 * det);
+	if (value0 > 255)
+		value0 = 255;
+	if (value1 > 255)
+		value1 = 255;
+	return mode == 0 ? value0 > value1 : value0 <= value1;
+}
+
+// Fit the value pair of the mode to the values by least squares, given the pixel indices
+// selected for them (one per byte of m_pixel_index with SSE2, packed otherwise). Each palette
+// value is (w * value0 + v * value1) / d with d = 7 in mode 0 and d = 5 in mode 1, where
+// pixel index 0 has w = d, pixel index 1 has v = d and pixel index k > 1 has w = d + 1 - k;
+// the values 0 and 255 of mode 1 do not depend on the value pair and are left out.
+#ifdef __SSE2__
+static DETEX_INLINE_ONLY bool FitValuePairRGTC1(__simd128_int m_values, __simd128_int m_pixel_index,
+int mode, int & DETEX_RESTRICT value0, int & DETEX_RESTRICT value1) {
+	int d = mode == 0 ? 7 : 5;
+	__simd128_int m_index0 = _mm_cmpeq_epi8(m_pixel_index, simd128_set_zero_int());
+	__simd128_int m_index1 = _mm_cmpeq_epi8(m_pixel_index, _mm_set1_epi8(1));
+	// Saturation sets w to zero for pixel indices 6 and 7 in mode 1.
+	__simd128_int m_w = _mm_subs_epu8(_mm_set1_epi8(d + 1), m_pixel_index);
+	m_w = simd128_or_int(simd128_andnot_int(simd128_or_int(m_index0, m_index1), m_w),
+		simd128_and_int(m_index0, _mm_set1_epi8(d)));
+	__simd128_int m_v = _mm_sub_epi8(_mm_set1_epi8(d), m_w);
+	if (mode == 1)
+		m_v = simd128_andnot_int(_mm_cmpgt_epi8(m_pixel_index, _mm_set1_epi8(5)), m_v);
+	return SolveValuePairRGTC1(mode, GetSumOfProductsSIMD8(m_w, m_w), GetSumOfProductsSIMD8(m_w, m_v),
+		GetSumOfProductsSIMD8(m_v, m_v), GetSumOfProductsSIMD8(m_w, m_values),
+		GetSumOfProductsSIMD8(m_v, m_values), value0, value1);
+}
+#else
+static bool FitValuePairRGTC1(const int * DETEX_RESTRICT values, uint64_t pixel_indices, int mode,
+int & DETEX_RESTRICT value0, int & DETEX_RESTRICT value1) {
+	// Accumulate the number and the sum of the values for each palette value.
+	int count[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int sum[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		int pixel_index = (pixel_indices >> (i * 3)) & 0x7;
+		count[pixel_index]++;
+		sum[pixel_index] += values[i];
+	}
+	int d = mode == 0 ? 7 : 5;
+	int nu_levels = mode == 0 ? 8 : 6;
+	int sum_ww = 0;
+	int sum_wv = 0;
+	int sum_vv = 0;
+	int sum_w_value = 0;
+	int sum_v_value = 0;
+	for (int k = 0; k < nu_levels; k++) {
+		int w = k == 0 ? d : (k == 1 ? 0 : d + 1 - k);
+		int v = d - w;
+		sum_ww += w * w * count[k];
+		sum_wv += w * v * count[k];
+		sum_vv += v * v * count[k];
+		sum_w_value += w * sum[k];
+		sum_v_value += v * sum[k];
+	}
+	return SolveValuePairRGTC1(mode, sum_ww, sum_wv, sum_vv, sum_w_value, sum_v_value, value0, value1);
+}
+#endif
+
+// Encode 16 values without a search, for textures that are compressed at run time: take the
+// best of the analytic value pairs (the minimum and maximum, inset, and the six-value pairs,
+// in mode or in both modes when mode is -1) and refine it once by a least-squares fit to the
+// pixel indices it selects. Returns the error and stores the encoding (the eight bytes of an
+// RGTC1 block or of the alpha of a BC3 block) in bitstring.
+uint32_t CompressValuesAnalyticRGTC1(const int * DETEX_RESTRICT values, int mode,
+uint8_t * DETEX_RESTRICT bitstring) {
+	uint32_t value_pairs[4];
+#ifdef __SSE2__
+	// The pixel indices are kept one per byte until the encoding is stored.
+	typedef __simd128_int pixel_indices_type;
+	__simd128_int m_values = LoadValuesSIMD8(values);
+	// The inner values exclude 0 and 255, which are masked to 255 for the minimum and to 0 for
+	// the maximum.
+	__simd128_int m_extreme = simd128_or_int(_mm_cmpeq_epi8(m_values, simd128_set_zero_int()),
+		_mm_cmpeq_epi8(m_values, _mm_set1_epi8(0xFF)));
+	int n = GetValueRangePairsRGTC1(GetMinimumSIMD8(m_values), GetMaximumSIMD8(m_values),
+		GetMinimumSIMD8(simd128_or_int(m_values, m_extreme)),
+		GetMaximumSIMD8(simd128_andnot_int(m_extreme, m_values)), 0, 255, mode, value_pairs);
+#define GET_PIXEL_INDICES(palette, pixel_indices) GetErrorSIMD8Levels(m_values, palette, pixel_indices)
+#define FIT_VALUE_PAIR(pixel_indices, m, value0, value1) FitValuePairRGTC1(m_values, pixel_indices, m, \
+	value0, value1)
+#else
+	typedef uint64_t pixel_indices_type;
+	int n = GetAnalyticValuePairsRGTC1(values, 0, 255, mode, value_pairs);
+#define GET_PIXEL_INDICES(palette, pixel_indices) SetValuePixelIndicesRGTC1(values, palette[0], palette[1], \
+	pixel_indices)
+#define FIT_VALUE_PAIR(pixel_indices, m, value0, value1) FitValuePairRGTC1(values, pixel_indices, m, \
+	value0, value1)
+#endif
+	uint32_t best_error = UINT_MAX;
+	int best_value0 = 0;
+	int best_value1 = 0;
+	pixel_indices_type best_pixel_indices;
+	for (int i = 0; i <= n; i++) {
+		int red[8];
+		if (i < n) {
+			red[0] = value_pairs[i] & 0xFF;
+			red[1] = value_pairs[i] >> 8;
+		}
+		// Refine the best value pair by a least-squares fit to its pixel indices.
+		else if (best_error == 0 || !FIT_VALUE_PAIR(best_pixel_indices,
+		best_value0 > best_value1 ? 0 : 1, red[0], red[1]))
+			break;
+		DecodeRedRGTC1(red);
+		pixel_indices_type pixel_indices;
+		uint32_t error = GET_PIXEL_INDICES(red, pixel_indices);
+		if (error < best_error) {
+			best_error = error;
+			best_value0 = red[0];
+			best_value1 = red[1];
+			best_pixel_indices = pixel_indices;
+		}
+	}
+#undef GET_PIXEL_INDICES
+#undef FIT_VALUE_PAIR
+#ifdef __SSE2__
+	uint64_t red_pixel_indices = PackPixelIndicesRGTC1(best_pixel_indices);
+#else
+	uint64_t red_pixel_indices = best_pixel_indices;
+#endif
+	*(uint64_t *)bitstring = best_value0 | (best_value1 << 8) | (red_pixel_indices << 16);
+	return best_error;
+}
+
+double CompressBlockAnalyticRGTC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	int values[16];
+	GetValuesRGTC1(info, values);
+	uint32_t error = CompressValuesAnalyticRGTC1(values, info->mode, bitstring);
+	return sqrt((double)error / 16.0d);
+}
+
 void SeedSignedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng,
 uint8_t * DETEX_RESTRICT bitstring) {
 	uint32_t red_values;
 	do {
 		red_values = rng->RandomBits(16);
 	}
-	while ((red_values & 0xFF) == 0xFF || (red_values >> 8) == 0xFF); // red0 == -128 or red1 == -128 not allowed.
+	while ((red_values & 0xFF) == 0x80 || (red_values >> 8) == 0x80); // red0 == -128 or red1 == -128 not allowed.
 	// Set the mode for RGTC1.
 	if (info->mode >= 0) {
 		int m = (red_values & 0xFF) <= (red_values >> 8);
@@ -208,6 +1125,25 @@ uint8_t * DETEX_RESTRICT bitstring) {
 	*(uint16_t *)(bitstring) = red_values;
 }
 
+int AnalyticSeedSignedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstrings) {
+	const uint8_t *pix_orig = GetBlockPixelsRGTC1(info) + info->component * 2;
+	int stride_orig = info->texture->width * info->pixel_size;
+	int values[16];
+	for (int dy = 0; dy < 4; dy++)
+		for (int dx = 0; dx < 4; dx++) {
+			// Map from -32768 to 32767 to the nearest value in the range -127 to 127.
+			int value = *(int16_t *)(pix_orig + dy * stride_orig + dx * info->pixel_size);
+			values[dy * 4 + dx] = ((value + 32768) * 254 + 32767) / 65535 - 127;
+		}
+	// Note that the mode is determined by the unsigned value bytes, like in the seeding and
+	// mutation functions, so a candidate may end up being used for the other mode.
+	uint32_t value_pairs[4];
+	int n = GetAnalyticValuePairsRGTC1(values, - 127, 127, info->mode, value_pairs);
+	for (int i = 0; i < n; i++)
+		*(uint16_t *)&bitstrings[i * 16] = value_pairs[i];
+	return n;
+}
+
 void MutateSignedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG * DETEX_RESTRICT rng, int generation,
 uint8_t * DETEX_RESTRICT bitstring) {
 	// Mutate red base values.
@@ -227,7 +1163,7 @@ uint8_t * DETEX_RESTRICT bitstring) {
 				red_values &= ~mask;
 				red_values |= value << detex_rgtc1_component_shift[component];
 			}
-			if ((red_values & 0xFF) == 0xFF || (red_values >> 8) == 0xFF)
+			if ((red_values & 0xFF) == 0x80 || (red_values >> 8) == 0x80)
 				// red0 or red1 value of -128 not allowed.
 				continue;
 			int m = (red_values & 0xFF) <= (red_values >> 8);
@@ -268,7 +1204,7 @@ uint8_t * DETEX_RESTRICT bitstring) {
 			red_values &= ~mask;
 			red_values |= (uint8_t)(int8_t)value << detex_rgtc1_component_shift[component];
 		}
-		if ((red_values & 0xFF) == 0xFF || (red_values >> 8) == 0xFF)
+		if ((red_values & 0xFF) == 0x80 || (red_values >> 8) == 0x80)
 			// red0 or red1 value of -128 not allowed.
 			continue;
 		int m = (red_values & 0xFF) <= (red_values >> 8);
@@ -279,8 +1215,8 @@ uint8_t * DETEX_RESTRICT bitstring) {
 }
 
 static DETEX_INLINE_ONLY uint64_t SetPixelXYSignedRGTC1(const uint8_t * DETEX_RESTRICT pix_orig, int stride_orig,
-int dx, int dy, const int * DETEX_RESTRICT red, uint64_t & DETEX_RESTRICT red_pixel_indices) {
-	int red_orig = *(int16_t *)(pix_orig + dy * stride_orig + dx * 2);
+int pixel_size, int dx, int dy, const int * DETEX_RESTRICT red, uint64_t & DETEX_RESTRICT red_pixel_indices) {
+	int red_orig = *(int16_t *)(pix_orig + dy * stride_orig + dx * pixel_size);
 	uint64_t best_error = (int64_t)(red_orig - red[0]) * (red_orig - red[0]);
 	int best_pixel_index = 0;
 	for (int i = 1; i < 8; i++) {
@@ -318,36 +1254,137 @@ static DETEX_INLINE_ONLY int MapFromMinus127To127ToMinus32768to32767(int value)
 	return ((value + 127) * 65535 / 254 - 32768);
 }
 
-uint64_t SetPixelsSignedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
-	const detexTexture *texture = info->texture;
-	int x = info->x;
-	int y = info->y;
+#ifdef __SSE2__
+
+// Pixel-parallel kernel for the eight-level palette of SIGNED_RGTC1. The 16-bit values (of
+// SIGNED_R16 pixels or one component of SIGNED_RG16 pixels) are sign-extended to 32-bit
+// lanes (one row of the block per register), the first palette value
+// with the lowest absolute difference is selected per pixel, and the squared errors (up to
+// 2^32) are summed in 64-bit lanes. The rows are evaluated one at a time so that the
+// evaluation can stop when the error reaches the bound.
+static DETEX_INLINE_ONLY uint64_t SetPixelIndicesSIMDSignedRGTC1(const uint8_t * DETEX_RESTRICT pix_orig,
+int stride_orig, int pixel_size, int component, const int * DETEX_RESTRICT red, uint64_t bound,
+uint64_t & DETEX_RESTRICT red_pixel_indices) {
+	__simd128_int m_red[8];
+	for (int k = 0; k < 8; k++)
+		m_red[k] = simd128_set_same_int32(red[k]);
+	__simd128_int m_error = simd128_set_zero_int();
+	__simd128_int m_best_pixel_index[4];
+	for (int dy = 0; dy < 4; dy++) {
+		__simd128_int m_values;
+		if (pixel_size == 2) {
+			__simd128_int m_row = _mm_loadl_epi64((const __m128i *)(pix_orig + dy * stride_orig));
+			m_values = _mm_srai_epi32(_mm_unpacklo_epi16(m_row, m_row), 16);
+		}
+		else {
+			__simd128_int m_row = _mm_loadu_si128((const __m128i *)(pix_orig + dy * stride_orig));
+			if (component == 0)
+				m_row = _mm_slli_epi32(m_row, 16);
+			m_values = _mm_srai_epi32(m_row, 16);
+		}
+		__simd128_int m_best_diff;
+		for (int k = 0; k < 8; k++) {
+			__simd128_int m_diff = simd128_sub_int32(m_values, m_red[k]);
+			__simd128_int m_sign = _mm_srai_epi32(m_diff, 31);
+			m_diff = simd128_sub_int32(_mm_xor_si128(m_diff, m_sign), m_sign);
+			if (k == 0) {
+				m_best_diff = m_diff;
+				m_best_pixel_index[dy] = simd128_set_zero_int();
+				continue;
+			}
+			__simd128_int m_cmp = _mm_cmplt_epi32(m_diff, m_best_diff);
+			m_best_diff = simd128_or_int(simd128_andnot_int(m_cmp, m_best_diff),
+				simd128_and_int(m_cmp, m_diff));
+			m_best_pixel_index[dy] = simd128_or_int(
+				simd128_andnot_int(m_cmp, m_best_pixel_index[dy]),
+				simd128_and_int(m_cmp, simd128_set_same_int32(k)));
+		}
+		__simd128_int m_diff_odd = _mm_srli_epi64(m_best_diff, 32);
+		m_error = _mm_add_epi64(m_error, _mm_mul_epu32(m_best_diff, m_best_diff));
+		m_error = _mm_add_epi64(m_error, _mm_mul_epu32(m_diff_odd, m_diff_odd));
+		if (dy < 3) {
+			// Stop when the error of the rows so far has reached the bound.
+			uint64_t error[2];
+			_mm_storeu_si128((__m128i *)error, m_error);
+			if (error[0] + error[1] >= bound) {
+				red_pixel_indices = 0;
+				return error[0] + error[1];
+			}
+		}
+	}
+	uint64_t error[2];
+	_mm_storeu_si128((__m128i *)error, m_error);
+	red_pixel_indices = PackPixelIndicesRGTC1(_mm_packus_epi16(
+		_mm_packs_epi32(m_best_pixel_index[0], m_best_pixel_index[1]),
+		_mm_packs_epi32(m_best_pixel_index[2], m_best_pixel_index[3])));
+	return error[0] + error[1];
+}
+
+#endif
+
+uint64_t SetPixelsSignedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring,
+uint64_t bound) {
 	int red[8];
 	red[0] = *(int8_t *)bitstring;
 	red[1] = *(int8_t *)(bitstring + 1);
 	DecodeRedSignedRGTC1(red);
 	for (int i = 0; i < 8; i++)
 		red[i] = MapFromMinus127To127ToMinus32768to32767(red[i]);
-	uint8_t *pix_orig = texture->data + (y * texture->width + x) * 2;
-	int stride_orig = texture->width * 2;
+	const uint8_t *pix_orig = GetBlockPixelsRGTC1(info);
+	int pixel_size = info->pixel_size;
+	int stride_orig = info->texture->width * pixel_size;
 	uint64_t red_pixel_indices = 0;
-	uint64_t error = SetPixelXYSignedRGTC1(pix_orig, stride_orig, 0, 0, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 1, 0, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 2, 0, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 3, 0, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 0, 1, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 1, 1, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 2, 1, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 3, 1, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 0, 2, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 1, 2, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 2, 2, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 3, 2, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 0, 3, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 1, 3, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 2, 3, red, red_pixel_indices);
-	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, 3, 3, red, red_pixel_indices);
+#ifdef __SSE2__
+	uint64_t error = SetPixelIndicesSIMDSignedRGTC1(pix_orig, stride_orig, pixel_size, info->component, red,
+		bound, red_pixel_indices);
+#else
+	pix_orig += info->component * 2;
+	uint64_t error = SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 0, 0, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 1, 0, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 2, 0, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 3, 0, red, red_pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 0, 1, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 1, 1, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 2, 1, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 3, 1, red, red_pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 0, 2, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 1, 2, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 2, 2, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 3, 2, red, red_pixel_indices);
+	if (error >= bound)
+		return error;
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 0, 3, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 1, 3, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 2, 3, red, red_pixel_indices);
+	error += SetPixelXYSignedRGTC1(pix_orig, stride_orig, pixel_size, 3, 3, red, red_pixel_indices);
+#endif
 	*(uint64_t *)bitstring = *(uint16_t *)bitstring | (red_pixel_indices << 16);
 	return error;
 }
 
+double CompressBlockSignedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, dstCMWCRNG *rng,
+uint8_t * DETEX_RESTRICT bitstring, const detexCompressionParameters * DETEX_RESTRICT params) {
+	return detexCompressBlock <uint64_t, 8, AnalyticSeedSignedRGTC1, SeedSignedRGTC1, MutateSignedRGTC1,
+		SetPixelsSignedRGTC1>(info, rng, bitstring, params);
+}
+
+bool EncodeTrivialSignedRGTC1(const detexBlockInfo * DETEX_RESTRICT info, uint8_t * DETEX_RESTRICT bitstring) {
+	const uint8_t *pix_orig = GetBlockPixelsRGTC1(info) + info->component * 2;
+	int stride_orig = info->texture->width * info->pixel_size;
+	int values[16];
+	for (int dy = 0; dy < 4; dy++)
+		for (int dx = 0; dx < 4; dx++) {
+			// The block can only be encoded exactly when each pixel value corresponds to
+			// one of the values in the range -127 to 127.
+			int value = *(int16_t *)(pix_orig + dy * stride_orig + dx * info->pixel_size);
+			int red = ((value + 32768) * 254 + 32767) / 65535 - 127;
+			if (MapFromMinus127To127ToMinus32768to32767(red) != value)
+				return false;
+			values[dy * 4 + dx] = red;
+		}
+	return EncodeExactValuePairRGTC1(values, - 127, 127, bitstring);
+}
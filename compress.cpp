@@ -21,6 +21,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "detex.h"
 #include "compress.h"
 #include "compress-block.h"
+#include "block-cache.h"
 
 // #define VERBOSE
 
@@ -141,7 +142,7 @@ static DETEX_INLINE_ONLY void AddErrorPixelXYSignedR16(const uint8_t * DETEX_RES
 const uint8_t * DETEX_RESTRICT pix2, int pix2_stride, int dx, int dy, uint64_t & DETEX_RESTRICT error) {
 	int r1 = *(int16_t *)(pix1 + (dy * 4 + dx) * 2);
 	int r2 = *(int16_t *)(pix2 + dy * pix2_stride + dx * 2);
-	error += (r1 - r2) * (r1 - r2);
+	error += (int64_t)(r1 - r2) * (r1 - r2);
 }
 
 static uint64_t detexCalculateErrorSignedR16(const detexTexture * DETEX_RESTRICT texture, int x, int y,
@@ -211,7 +212,7 @@ const uint8_t * DETEX_RESTRICT pix2, int pix2_stride, int dx, int dy, uint64_t &
 	int g1 = *(int16_t *)(pix1 + (dy * 4 + dx) * 4 + 2);
 	int g2 = *(int16_t *)(pix2 + dy * pix2_stride + dx * 4 + 2);
 	error += (int64_t)(r1 - r2) * (r1 - r2);
-	error += (int64_t)(g2 - g2) * (g1 - g2);
+	error += (int64_t)(g1 - g2) * (g1 - g2);
 }
 
 static uint64_t detexCalculateErrorSignedRG16(const detexTexture * DETEX_RESTRICT texture, int x, int y,
@@ -278,51 +279,67 @@ static const int *detexGetModes0123(const detexBlockInfo *block_info) {
 	return detex_modes_0123;
 }
 
+// Entry of the per-instruction set table of block compression functions. Without AVX2 kernels
+// in the build, the baseline function is used for every instruction set.
+#ifdef DETEX_AVX2_KERNELS
+#define DETEX_COMPRESS_BLOCK_FUNCS(baseline_func, avx2_func) { baseline_func, avx2_func }
+#else
+#define DETEX_COMPRESS_BLOCK_FUNCS(baseline_func, avx2_func) { baseline_func, baseline_func }
+#endif
+
 static const detexCompressionInfo compression_info[] = {
 	// BC1
-	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT32, SeedBC1, detexSetModeBC1,
-	MutateBC1, SetPixelsBC1, detexCalculateErrorRGBX8 },
+	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT32,
+	DETEX_COMPRESS_BLOCK_FUNCS(CompressBlockBC1, CompressBlockBC1AVX2), EncodeTrivialBC1,
+	detexSetModeBC1, detexCalculateErrorRGBX8, NULL, CompressBlockAnalyticBC1 },
 	// BC1A
-	{ 2, true, GetModesBC1A, DETEX_ERROR_UNIT_UINT32, SeedBC1, detexSetModeBC1,
-	MutateBC1, SetPixelsBC1A, detexCalculateErrorRGBA8 },
+	{ 2, true, GetModesBC1A, DETEX_ERROR_UNIT_UINT32,
+	DETEX_COMPRESS_BLOCK_FUNCS(CompressBlockBC1A, CompressBlockBC1A), EncodeTrivialBC1A,
+	detexSetModeBC1, detexCalculateErrorRGBA8, NULL, CompressBlockAnalyticBC1A },
 	// BC2
 	// Use modal configuration with just one mode. This ensures the color definitions
 	// comply to mode 0, as required for BC2.
-	{ 1, true, detexGetModes0, DETEX_ERROR_UNIT_UINT32, SeedBC2, NULL,
-	MutateBC2, SetPixelsBC2, detexCalculateErrorRGBA8 },
+	{ 1, true, detexGetModes0, DETEX_ERROR_UNIT_UINT32,
+	DETEX_COMPRESS_BLOCK_FUNCS(CompressBlockBC2, CompressBlockBC2AVX2), EncodeTrivialBC2,
+	NULL, detexCalculateErrorRGBA8 },
 	// BC3
-	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT32, SeedBC3, NULL,
-	MutateBC3, SetPixelsBC3, detexCalculateErrorRGBA8 },
+	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT32,
+	DETEX_COMPRESS_BLOCK_FUNCS(CompressBlockBC3, CompressBlockBC3AVX2), EncodeTrivialBC3,
+	NULL, detexCalculateErrorRGBA8 },
 	// RGTC1
-	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT32, SeedRGTC1, NULL,
-	MutateRGTC1, SetPixelsRGTC1, detexCalculateErrorR8 },
+	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT32,
+	DETEX_COMPRESS_BLOCK_FUNCS(CompressBlockRGTC1, CompressBlockRGTC1AVX2), EncodeTrivialRGTC1,
+	NULL, detexCalculateErrorR8, CompressBlockExhaustiveRGTC1, CompressBlockAnalyticRGTC1 },
 	// SIGNED_RGTC1
-	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT64, SeedSignedRGTC1, NULL,
-	MutateSignedRGTC1, (detexSetPixelsFunc)SetPixelsSignedRGTC1,
-	(detexCalculateErrorFunc)detexCalculateErrorSignedR16 },
+	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT64,
+	DETEX_COMPRESS_BLOCK_FUNCS(CompressBlockSignedRGTC1, CompressBlockSignedRGTC1),
+	EncodeTrivialSignedRGTC1, NULL, (detexCalculateErrorFunc)detexCalculateErrorSignedR16 },
 	// RGTC2
-	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT32, NULL, NULL,
-	NULL, NULL, detexCalculateErrorRG8 },
+	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT32, { NULL, NULL }, NULL,
+	NULL, detexCalculateErrorRG8 },
 	// SIGNED_RGTC2
-	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT64, NULL, NULL,
-	NULL, NULL, (detexCalculateErrorFunc)detexCalculateErrorSignedRG16 },
+	{ 2, true, detexGetModes01, DETEX_ERROR_UNIT_UINT64, { NULL, NULL }, NULL,
+	NULL, (detexCalculateErrorFunc)detexCalculateErrorSignedRG16 },
 	// BPTC_FLOAT
-	{ 14, true, NULL, DETEX_ERROR_UNIT_DOUBLE, NULL, NULL,
-	NULL, NULL, NULL },
+	{ 14, true, NULL, DETEX_ERROR_UNIT_DOUBLE, { NULL, NULL }, NULL,
+	NULL, NULL },
 	// BPTC_SIGNED_FLOAT
-	{ 14, true, NULL, DETEX_ERROR_UNIT_DOUBLE, NULL, NULL,
-	NULL, NULL, NULL },
+	{ 14, true, NULL, DETEX_ERROR_UNIT_DOUBLE, { NULL, NULL }, NULL,
+	NULL, NULL },
 	// BPTC
-	{ 8, true, NULL, DETEX_ERROR_UNIT_DOUBLE, NULL, NULL,
-	NULL, NULL, NULL },
+	{ 8, true, NULL, DETEX_ERROR_UNIT_DOUBLE, { NULL, NULL }, NULL,
+	NULL, NULL },
 	// ETC1
-	{ 4, true, detexGetModes0123, DETEX_ERROR_UNIT_UINT32, SeedETC1, NULL,
-	MutateETC1, SetPixelsETC1, detexCalculateErrorRGBX8 },
+	{ 4, true, detexGetModes0123, DETEX_ERROR_UNIT_UINT32,
+	DETEX_COMPRESS_BLOCK_FUNCS(CompressBlockETC1, CompressBlockETC1AVX2), EncodeTrivialETC1,
+	NULL, detexCalculateErrorRGBX8, NULL, CompressBlockAnalyticETC1 },
 };
 
-// Determine block flags for RGBA8/RGBX8 block (whether it is completely opaque or non-opaque,
-// whether it uses only a limited amount of colors).
-static void SetBlockFlags(detexBlockInfo *block_info, uint32_t format) {
+// Stage the pixels of an RGBA8/RGBX8 block with their statistics (see detexBlockPixels) and
+// determine the block flags (whether it is completely opaque or non-opaque, whether it uses
+// only a limited amount of colors) in the same pass. For other pixel formats, the block is
+// not staged and only the flags that follow from the format are set.
+static void StageBlock(detexBlockInfo *block_info, uint32_t format, detexBlockPixels *pixels) {
 	if (format == DETEX_PIXEL_FORMAT_RGBA8)
 		block_info->flags = DETEX_BLOCK_FLAG_OPAQUE | DETEX_BLOCK_FLAG_TRANSPARENT | DETEX_BLOCK_FLAG_PUNCHTHROUGH |
 			DETEX_BLOCK_FLAG_MAX_TWO_COLORS;
@@ -330,38 +347,66 @@ static void SetBlockFlags(detexBlockInfo *block_info, uint32_t format) {
 		block_info->flags = DETEX_BLOCK_FLAG_OPAQUE | DETEX_BLOCK_FLAG_PUNCHTHROUGH |
 			 DETEX_BLOCK_FLAG_MAX_TWO_COLORS;
 	else {
+		block_info->pixels = NULL;
 		if (detexFormatHasAlpha(format))
 			block_info->flags = 0; 
 		else 
 			block_info->flags = DETEX_BLOCK_FLAG_OPAQUE | DETEX_BLOCK_FLAG_PUNCHTHROUGH;
 		return;
 	}
+	const detexTexture *texture = block_info->texture;
+	const uint8_t *pix_orig = texture->data + (block_info->y * texture->width + block_info->x) * 4;
+	int stride_orig = texture->width * 4;
+	int sum_of_products[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int c = 0; c < 3; c++) {
+		pixels->min_color[c] = 255;
+		pixels->max_color[c] = 0;
+		pixels->sum[c] = 0;
+	}
 	int color0 = - 1;
 	int color1 = - 1;
-	for (int by = 0; by < 4; by++)
-		for (int bx = 0; bx < 4; bx++) {
-			uint32_t pixel = *(uint32_t *)(block_info->texture->data +
-				((block_info->y + by) * block_info->texture->width + block_info->x + bx) * 4);
-			if (format == DETEX_PIXEL_FORMAT_RGBA8) {
-				int alpha = detexPixel32GetA8(pixel);
-				if (alpha == 0xFF)
-					block_info->flags &= (~DETEX_BLOCK_FLAG_TRANSPARENT);
-				else {
-					block_info->flags &= (~DETEX_BLOCK_FLAG_OPAQUE);
-					if (alpha != 0x00)
-						block_info->flags &= (~DETEX_BLOCK_FLAG_PUNCHTHROUGH);
-				}
-			}
-			int rgb = pixel & 0xFFFFFF;
-			if (color0 == - 1)
-				color0 = rgb;
-			else if (rgb != color0) {
-				if (color1 == - 1)
-					color1 = rgb;
-				else if (rgb != color1)
-					block_info->flags &= (~DETEX_BLOCK_FLAG_MAX_TWO_COLORS);
+	for (int i = 0; i < 16; i++) {
+		uint32_t pixel = *(uint32_t *)(pix_orig + (i / 4) * stride_orig + (i % 4) * 4);
+		int color[3];
+		color[0] = pixels->r[i] = detexPixel32GetR8(pixel);
+		color[1] = pixels->g[i] = detexPixel32GetG8(pixel);
+		color[2] = pixels->b[i] = detexPixel32GetB8(pixel);
+		pixels->a[i] = detexPixel32GetA8(pixel);
+		int k = 0;
+		for (int c = 0; c < 3; c++) {
+			if (color[c] < pixels->min_color[c])
+				pixels->min_color[c] = color[c];
+			if (color[c] > pixels->max_color[c])
+				pixels->max_color[c] = color[c];
+			pixels->sum[c] += color[c];
+			for (int c2 = c; c2 < 3; c2++, k++)
+				sum_of_products[k] += color[c] * color[c2];
+		}
+		if (format == DETEX_PIXEL_FORMAT_RGBA8) {
+			int alpha = pixels->a[i];
+			if (alpha == 0xFF)
+				block_info->flags &= (~DETEX_BLOCK_FLAG_TRANSPARENT);
+			else {
+				block_info->flags &= (~DETEX_BLOCK_FLAG_OPAQUE);
+				if (alpha != 0x00)
+					block_info->flags &= (~DETEX_BLOCK_FLAG_PUNCHTHROUGH);
 			}
 		}
+		int rgb = pixel & 0xFFFFFF;
+		if (color0 == - 1)
+			color0 = rgb;
+		else if (rgb != color0) {
+			if (color1 == - 1)
+				color1 = rgb;
+			else if (rgb != color1)
+				block_info->flags &= (~DETEX_BLOCK_FLAG_MAX_TWO_COLORS);
+		}
+	}
+	int k = 0;
+	for (int c = 0; c < 3; c++)
+		for (int c2 = c; c2 < 3; c2++, k++)
+			pixels->covariance[k] = 16 * sum_of_products[k] - pixels->sum[c] * pixels->sum[c2];
+	block_info->pixels = pixels;
 	if (block_info->flags & DETEX_BLOCK_FLAG_MAX_TWO_COLORS) {
 		block_info->colors[0] = color0;
 		if (color1 == - 1)
@@ -371,142 +416,380 @@ static void SetBlockFlags(detexBlockInfo *block_info, uint32_t format) {
 	}
 }
 
+// A texture (usually a mipmap level) that is part of a compression task.
+struct CompressLevel {
+	const detexTexture *texture;
+	// The compressed blocks are stored block_stride bytes apart, starting at pixel_buffer.
+	uint8_t *pixel_buffer;
+	int block_stride;
+	int nu_blocks;
+	// Index of the component (for formats such as RGTC2 that are compressed one component
+	// at a time). The components are compressed directly from the texture; pixel_format is
+	// the pixel format of the compressed component (the texture format when the texture is
+	// compressed as a whole).
+	int component;
+	uint32_t pixel_format;
+	// Blocks that are byte-identical to an earlier block of the level are only compressed
+	// once. unique_blocks holds the indices of the blocks that are compressed, and
+	// representatives holds for every block the index of the unique block with the same
+	// contents.
+	int nu_unique_blocks;
+	int *unique_blocks;
+	int *representatives;
+};
 
-static double detexCompressBlock(const detexCompressionInfo * DETEX_RESTRICT info,
-const detexBlockInfo * DETEX_RESTRICT block_info, dstCMWCRNG *rng,
-uint8_t * DETEX_RESTRICT bitstring_out, uint32_t output_format) {
-	uint8_t bitstring[16];
-//	uint8_t pixel_buffer[DETEX_MAX_BLOCK_SIZE];
-	int compressed_block_size = detexGetCompressedBlockSize(output_format);
-	uint32_t best_error_uint32 = UINT_MAX;
-	uint64_t best_error_uint64 = UINT64_MAX;
-	double best_error_double = DBL_MAX;
-	int last_improvement_generation = -1;
-	for (int generation = 0; generation < 2048 || last_improvement_generation > generation - 384;) {
-		if (generation < 256) {
-			// For the first 256 iterations, use the seeding function.
-			info->seed_func(block_info, rng, bitstring);
-		}
-		else {
-			// From iteration 256, use mutation.
-			memcpy(bitstring, bitstring_out, compressed_block_size);
-			info->mutate_func(block_info, rng, generation,bitstring);
-		}
-		uint32_t error_uint32;
-		uint64_t error_uint64;
-		double error_double;
-		bool is_better;
-		if (info->error_unit == DETEX_ERROR_UNIT_UINT32) {
-			error_uint32 = info->set_pixels_error_uint32_func(block_info, bitstring);
-			is_better = (error_uint32 < best_error_uint32);
-			if (is_better)
-				best_error_uint32 = error_uint32;
-#ifdef VERBOSE
-			if ((generation & 127) == 0)
-				printf("Gen %d: RMSE = %.3f\n", generation,
-					sqrt((double)best_error_uint32 / 16.0d));
-#endif
-		}
-		else if (info->error_unit == DETEX_ERROR_UNIT_UINT64) {
-			error_uint64 = info->set_pixels_error_uint64_func(block_info, bitstring);
-			is_better = (error_uint64 < best_error_uint64);
-			if (is_better)
-				best_error_uint64 = error_uint64;
+// Shared state for a compression run. The unique blocks of all levels of the task are numbered
+// consecutively, largest level first. Threads claim chunks of consecutive blocks from the
+// shared block counter until all blocks have been compressed, so that the total running
+// time follows the total amount of work rather than the slowest region or level.
+struct CompressTask {
+	int nu_levels;
+	const CompressLevel *levels;
+	uint32_t output_format;
+	const detexCompressionParameters *params;
+	int nu_blocks;
+	int nu_blocks_per_chunk;
+	int next_block;
+	// Block cache key of the settings that affect the compressed result.
+	uint64_t cache_seed[2];
+	int nu_cache_lookups;
+	int nu_cache_hits;
+};
+
+static DETEX_INLINE_ONLY uint32_t MixBits32(uint32_t h) {
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35;
+	h ^= h >> 16;
+	return h;
+}
+
+// Derive the random number generator seed for a block try in deterministic mode. The seed
+// only depends on the global seed, the level dimensions and component, the block position
+// and the try index, so that the result does not depend on the number of threads, on the
+// order in which blocks are compressed or on whether levels are compressed concurrently.
+static uint32_t GetBlockSeed(uint32_t seed, const CompressLevel *level, int x, int y, int try_index) {
+	uint32_t h = MixBits32(seed ^ 0x9E3779B9);
+	h = MixBits32(h ^ ((uint32_t)level->texture->height << 16) ^ level->texture->width);
+	h = MixBits32(h ^ level->component);
+	h = MixBits32(h ^ ((uint32_t)(y / 4) << 16) ^ (x / 4));
+	h = MixBits32(h ^ try_index);
+	return h;
+}
+
+static DETEX_INLINE_ONLY const uint8_t *GetBlockPixels(const detexTexture *texture, int pixel_size, int i) {
+	int width_in_blocks = texture->width / 4;
+	return texture->data + ((i / width_in_blocks) * 4 * texture->width + (i % width_in_blocks) * 4) *
+		pixel_size;
+}
+
+// Revision of the block encoders. The compressor version is not bumped for every change
+// of the encoders, so increase this whenever a change alters the compressed output, to
+// prevent a block cache from returning blocks compressed by an older encoder.
+#define DETEX_BLOCK_CACHE_ALGORITHM_REVISION 9
+
+// Calculate the block cache key of the settings that affect the compressed result: the
+// compressor version and encoder revision, the output format and the effort and seed
+// settings.
+static void CalculateSettingsCacheKey(const detexCompressionParameters *params, uint32_t output_format,
+uint64_t *key) {
+	const uint64_t seed[2] = { 0, 0 };
+	detexCalculateBlockCacheKey((const uint8_t *)DETEX_COMPRESS_VERSION, strlen(DETEX_COMPRESS_VERSION),
+		seed, key);
+	uint32_t settings[11];
+	settings[0] = output_format;
+	settings[1] = params->nu_tries;
+	settings[2] = params->modal;
+	settings[3] = params->flags;
+	settings[4] = params->seed;
+	settings[5] = params->nu_generations;
+	settings[6] = params->nu_seed_generations;
+	settings[7] = params->nu_stale_generations;
+	memcpy(&settings[8], &params->target_rmse, sizeof(double));
+	settings[10] = DETEX_BLOCK_CACHE_ALGORITHM_REVISION;
+	detexCalculateBlockCacheKey((const uint8_t *)settings, sizeof(settings), key, key);
+	if (params->modes != NULL) {
+		int nu_modes = 0;
+		while (params->modes[nu_modes] >= 0)
+			nu_modes++;
+		detexCalculateBlockCacheKey((const uint8_t *)params->modes, sizeof(int) * nu_modes, key, key);
+	}
+}
+
+// Copy the pixels of block i of the level in the pixel format of the compressed component
+// to data, and return the size of a row of the block.
+static int GetBlockComponentPixels(const CompressLevel *level, int i, uint8_t *data) {
+	const detexTexture *texture = level->texture;
+	int pixel_size = detexGetPixelSize(texture->format);
+	int stride = texture->width * pixel_size;
+	const uint8_t *pix = GetBlockPixels(texture, pixel_size, i);
+	if (level->pixel_format == texture->format) {
+		int row_size = pixel_size * 4;
+		for (int y = 0; y < 4; y++)
+			memcpy(data + y * row_size, pix + y * stride, row_size);
+		return row_size;
+	}
+	int component_size = detexGetPixelSize(level->pixel_format);
+	pix += level->component * component_size;
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++)
+			memcpy(data + (y * 4 + x) * component_size, pix + y * stride + x * pixel_size,
+				component_size);
+	return component_size * 4;
+}
+
+// Calculate the block cache key of a block from its pixels (in the pixel format used for
+// compression) and the settings key of the task.
+static void CalculateBlockCacheKey(const CompressTask *task, const CompressLevel *level, int i,
+uint64_t *key) {
+	uint8_t data[4 + 4 * 4 * 16];
+	*(uint32_t *)data = level->pixel_format;
+	int row_size = GetBlockComponentPixels(level, i, data + 4);
+	detexCalculateBlockCacheKey(data, 4 + row_size * 4, task->cache_seed, key);
+}
+
+// Compress the block with the given index, trying each mode when modal operation is enabled.
+static void CompressBlockWithTries(CompressTask * DETEX_RESTRICT task, dstCMWCRNG *rng, int i) {
+	// Determine the level the block belongs to.
+	const CompressLevel *level = task->levels;
+	while (i >= level->nu_unique_blocks) {
+		i -= level->nu_unique_blocks;
+		level++;
+	}
+	i = level->unique_blocks[i];
+	const detexTexture *texture = level->texture;
+	uint8_t *block_buffer = level->pixel_buffer + i * level->block_stride;
+	int compressed_format_index = detexGetCompressedFormat(task->output_format);
+	int block_size = detexGetCompressedBlockSize(task->output_format);
+	int width_in_blocks = texture->width / 4;
+	detexBlockInfo block_info;
+	block_info.texture = texture;
+	block_info.x = (i % width_in_blocks) * 4;
+	block_info.y = (i / width_in_blocks) * 4;
+	block_info.pixel_size = detexGetPixelSize(texture->format);
+	block_info.component = level->component;
+	block_info.ignored_pixel_mask = 0;
+	detexBlockPixels block_pixels;
+	StageBlock(&block_info, texture->format, &block_pixels);
+	// Blocks for which an optimal encoding can be determined directly (such as solid color
+	// blocks) skip the search. The direct encoding may use any mode, so it is not used when
+	// the modes are restricted.
+	const detexCompressionInfo *info = &compression_info[compressed_format_index - 1];
+	if (info->encode_trivial_func != NULL && task->params->modes == NULL &&
+	info->encode_trivial_func(&block_info, block_buffer))
+		return;
+	const detexCompressionParameters *params = task->params;
+	uint64_t cache_key[2];
+	if (params->cache != NULL) {
+		CalculateBlockCacheKey(task, level, i, cache_key);
+		__sync_fetch_and_add(&task->nu_cache_lookups, 1);
+		if (detexLookupBlockCache(params->cache, cache_key, block_buffer, block_size)) {
+			__sync_fetch_and_add(&task->nu_cache_hits, 1);
+			return;
 		}
-		else if (info->error_unit == DETEX_ERROR_UNIT_DOUBLE) {
-			error_double = info->set_pixels_error_double_func(block_info, bitstring);
-			is_better = (error_double < best_error_double);
-			if (is_better)
-				best_error_double = error_double;
+	}
+	detexCompressBlockFunc compress_block_func = info->compress_block_func[params->isa];
+	int nu_tries = params->nu_tries;
+	bool modal = params->modal;
+	// The exhaustive search finds the optimal encoding in a single try. The analytic encoding
+	// (which takes precedence) does not use the random number generator and derives the
+	// candidates of all modes at once, unless the modes are restricted.
+	if ((params->flags & DETEX_COMPRESS_FLAG_ANALYTIC) && info->compress_block_analytic_func != NULL) {
+		compress_block_func = info->compress_block_analytic_func;
+		nu_tries = 1;
+		if (params->modes == NULL)
+			modal = false;
+	}
+	else if ((params->flags & DETEX_COMPRESS_FLAG_EXHAUSTIVE) && info->compress_block_exhaustive_func != NULL) {
+		compress_block_func = info->compress_block_exhaustive_func;
+		nu_tries = 1;
+	}
+	double best_rmse = DBL_MAX;
+	for (int j = 0; j < nu_tries; j++) {
+		uint8_t bitstring[16];
+		if (params->flags & DETEX_COMPRESS_FLAG_DETERMINISTIC)
+			rng->Seed(GetBlockSeed(params->seed, level, block_info.x, block_info.y, j));
+		if (modal) {
+			// Compress the block using each mode.
+			const int *modesp;
+			if (params->modes == NULL)
+				modesp = info->get_modes_func(&block_info);
+			else
+				modesp = params->modes;
+			int mode;
+			for (;mode = *modesp, mode >= 0; modesp++) {
+				block_info.mode = mode;
+				double rmse = compress_block_func(&block_info, rng, bitstring, params);
+				if (rmse < best_rmse) {
+					best_rmse = rmse;
+					memcpy(block_buffer, bitstring, block_size);
+					if (rmse <= params->target_rmse)
+						break;
+				}
+			}
 		}
-		if (is_better) {
-			memcpy(bitstring_out, bitstring, compressed_block_size);
-			last_improvement_generation = generation;
+		else {
+			block_info.mode = -1;
+			double rmse = compress_block_func(&block_info, rng, bitstring, params);
+			if (rmse < best_rmse) {
+				best_rmse = rmse;
+				memcpy(block_buffer, bitstring, block_size);
+			}
 		}
-		generation++;
-		if (info->error_unit == DETEX_ERROR_UNIT_UINT32 && error_uint32 == 0)
+		if (best_rmse <= params->target_rmse)
 			break;
 	}
-	double rmse = sqrt((double)best_error_uint32 / 16.0d);
-#ifdef VERBOSE
-	printf("Block RMSE (mode %d): %.3f\n", block_info->mode, rmse);
-#endif
-	return rmse;
+	if (params->cache != NULL)
+		detexInsertBlockCache(params->cache, cache_key, block_buffer, block_size);
 }
 
-struct ThreadData {
-	const detexTexture *texture;
-	uint8_t *pixel_buffer;
-	uint32_t output_format;
-	int x_start;
-	int y_start;
-	int x_end;
-	int y_end;
-	int nu_tries;
-	bool modal;
-	int *modes;
+// Compress blocks of the task until no unclaimed blocks are left.
+static void CompressBlocks(CompressTask * DETEX_RESTRICT task, dstCMWCRNG *rng) {
+	for (;;) {
+		// Atomically claim the next chunk of blocks.
+		int i = __sync_fetch_and_add(&task->next_block, task->nu_blocks_per_chunk);
+		if (i >= task->nu_blocks)
+			break;
+		int i_end = i + task->nu_blocks_per_chunk;
+		if (i_end > task->nu_blocks)
+			i_end = task->nu_blocks;
+		for (; i < i_end; i++)
+			CompressBlockWithTries(task, rng, i);
+	}
+}
+
+// Per-thread state of the persistent compression thread pool.
+struct WorkerData {
+	pthread_t thread;
 	dstCMWCRNG *rng;
 };
 
-static void *CompressBlocksThread(void *_thread_data) {
-	ThreadData *thread_data = (ThreadData *)_thread_data;
-	const detexTexture *texture = thread_data->texture;
-	uint8_t *pixel_buffer = thread_data->pixel_buffer;
-	int compressed_format_index = detexGetCompressedFormat(thread_data->output_format);
-	int block_size = detexGetCompressedBlockSize(thread_data->output_format);
-	for (int y = thread_data->y_start; y < thread_data->y_end; y += 4)
-		for (int x = 0; x < thread_data->x_end; x += 4) {
-			detexBlockInfo block_info;
-			block_info.texture = texture;
-			block_info.x = x;
-			block_info.y = y;
-			SetBlockFlags(&block_info, texture->format);
-			// Calculate the block index.
-			int i = (y / 4) * (texture->width / 4) + x / 4;
-			double best_rmse = DBL_MAX;
-			for (int j = 0; j < thread_data->nu_tries; j++) {
-				uint8_t bitstring[16];
-				if (thread_data->modal) {
-					// Compress the block using each mode.
-					const int *modesp;
-					if (thread_data->modes == NULL)
-						modesp = compression_info[compressed_format_index - 1].get_modes_func(
-							&block_info);
-					else
-						modesp = thread_data->modes;
-					int mode;
-					for (;mode = *modesp, mode >= 0; modesp++) {
-						block_info.mode = mode;
-						double rmse = detexCompressBlock(
-							&compression_info[compressed_format_index - 1],
-							&block_info, thread_data->rng,
-							bitstring, thread_data->output_format);
-						if (rmse < best_rmse) {
-							best_rmse = rmse;
-							memcpy(&pixel_buffer[i * block_size], bitstring, block_size);
-							if (rmse == 0.0d)
-								break;
-						}
-					}
-				}
-				else {
-					block_info.mode = -1;
-					double rmse = detexCompressBlock(
-						&compression_info[compressed_format_index - 1],
-						&block_info, thread_data->rng,
-						bitstring, thread_data->output_format);
-					if (rmse < best_rmse) {
-						best_rmse = rmse;
-						memcpy(&pixel_buffer[i * block_size], bitstring, block_size);
-					}
-				}
-				if (best_rmse == 0.0d)
-					break;
-			}
-		}
+// The thread pool is created once and reused for every compression task in the process.
+// The calling thread always takes part in a task as the last worker, so that a pool of
+// n threads only creates n - 1 additional threads. run_mutex serializes the tasks and the
+// starting and stopping of the pool; mutex protects the task state shared with the workers.
+static struct {
+	int nu_threads;
+	WorkerData *workers;
+	pthread_mutex_t mutex;
+	pthread_mutex_t run_mutex;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+	CompressTask *task;
+	int task_serial;
+	int nu_workers_busy;
+	bool exit;
+} thread_pool = { 0, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, false };
+
+static void *WorkerThread(void *_worker) {
+	WorkerData *worker = (WorkerData *)_worker;
+	int task_serial = 0;
+	pthread_mutex_lock(&thread_pool.mutex);
+	for (;;) {
+		while (thread_pool.task_serial == task_serial && !thread_pool.exit)
+			pthread_cond_wait(&thread_pool.start_cond, &thread_pool.mutex);
+		if (thread_pool.exit)
+			break;
+		task_serial = thread_pool.task_serial;
+		CompressTask *task = thread_pool.task;
+		pthread_mutex_unlock(&thread_pool.mutex);
+		CompressBlocks(task, worker->rng);
+		pthread_mutex_lock(&thread_pool.mutex);
+		thread_pool.nu_workers_busy--;
+		if (thread_pool.nu_workers_busy == 0)
+			pthread_cond_signal(&thread_pool.done_cond);
+	}
+	pthread_mutex_unlock(&thread_pool.mutex);
 	return NULL;
 }
 
+// Stop the threads of the pool. The caller holds thread_pool.run_mutex.
+static void StopThreadPool() {
+	if (thread_pool.workers == NULL)
+		return;
+	pthread_mutex_lock(&thread_pool.mutex);
+	thread_pool.exit = true;
+	pthread_cond_broadcast(&thread_pool.start_cond);
+	pthread_mutex_unlock(&thread_pool.mutex);
+	for (int i = 0; i < thread_pool.nu_threads - 1; i++)
+		pthread_join(thread_pool.workers[i].thread, NULL);
+	for (int i = 0; i < thread_pool.nu_threads; i++)
+		delete thread_pool.workers[i].rng;
+	free(thread_pool.workers);
+	thread_pool.workers = NULL;
+	thread_pool.nu_threads = 0;
+}
+
+// Start the pool, or restart it with a different number of threads. The caller holds
+// thread_pool.run_mutex, so that the pool is not replaced while a task is running on it.
+static void StartThreadPool(int max_threads) {
+	int nu_threads;
+	if (max_threads > 0)
+		nu_threads = max_threads;
+	else
+		// A number of threads higher than the number of CPU cores helps performance
+		// on PC-class devices.
+		nu_threads = sysconf(_SC_NPROCESSORS_CONF) * 2;
+	if (thread_pool.workers != NULL) {
+		// Keep the running pool unless a different number of threads was requested.
+		if (max_threads <= 0 || thread_pool.nu_threads == nu_threads)
+			return;
+		StopThreadPool();
+	}
+	thread_pool.nu_threads = nu_threads;
+	thread_pool.workers = (WorkerData *)malloc(sizeof(WorkerData) * nu_threads);
+	thread_pool.task_serial = 0;
+	thread_pool.nu_workers_busy = 0;
+	thread_pool.exit = false;
+	for (int i = 0; i < nu_threads; i++) {
+		thread_pool.workers[i].rng = new dstCMWCRNG;
+		if (i < nu_threads - 1)
+			pthread_create(&thread_pool.workers[i].thread, NULL, WorkerThread,
+				&thread_pool.workers[i]);
+	}
+}
+
+void detexStartCompressionThreads(int max_threads) {
+	pthread_mutex_lock(&thread_pool.run_mutex);
+	StartThreadPool(max_threads);
+	pthread_mutex_unlock(&thread_pool.run_mutex);
+}
+
+void detexStopCompressionThreads() {
+	pthread_mutex_lock(&thread_pool.run_mutex);
+	StopThreadPool();
+	pthread_mutex_unlock(&thread_pool.run_mutex);
+}
+
+// Run a task on all threads of the pool (which is started if it is not running yet) and wait
+// until it has been completed.
+static void RunCompressTask(CompressTask *task, int max_threads) {
+	pthread_mutex_lock(&thread_pool.run_mutex);
+	StartThreadPool(max_threads);
+	// Use chunks that are small enough for good load balancing (about 16 chunks per
+	// thread), but large enough to keep contention on the shared counter low. Small
+	// textures use chunks of one block so that all threads can take part.
+	task->nu_blocks_per_chunk = task->nu_blocks / (thread_pool.nu_threads * 16);
+	if (task->nu_blocks_per_chunk > 64)
+		task->nu_blocks_per_chunk = 64;
+	if (task->nu_blocks_per_chunk < 1)
+		task->nu_blocks_per_chunk = 1;
+	pthread_mutex_lock(&thread_pool.mutex);
+	thread_pool.task = task;
+	thread_pool.task_serial++;
+	thread_pool.nu_workers_busy = thread_pool.nu_threads - 1;
+	pthread_cond_broadcast(&thread_pool.start_cond);
+	pthread_mutex_unlock(&thread_pool.mutex);
+	CompressBlocks(task, thread_pool.workers[thread_pool.nu_threads - 1].rng);
+	pthread_mutex_lock(&thread_pool.mutex);
+	while (thread_pool.nu_workers_busy > 0)
+		pthread_cond_wait(&thread_pool.done_cond, &thread_pool.mutex);
+	pthread_mutex_unlock(&thread_pool.mutex);
+	pthread_mutex_unlock(&thread_pool.run_mutex);
+}
+
 static bool VerifyModes(int *modes, int nu_modes) {
 	int mode;
 	for (;; modes++) {
@@ -519,118 +802,271 @@ static bool VerifyModes(int *modes, int nu_modes) {
 	return true;
 }
 
-bool detexCompressTexture(int nu_tries, bool modal, int max_threads, int *modes,
-const detexTexture * DETEX_RESTRICT texture, uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t output_format) {
+static uint32_t HashBlock(const uint8_t *data, int size) {
+	// FNV-1a.
+	uint32_t h = 0x811C9DC5;
+	for (int i = 0; i < size; i++)
+		h = (h ^ data[i]) * 0x01000193;
+	return h;
+}
+
+// Find the blocks of the level that are byte-identical to an earlier block of the level (in
+// the pixel format used for compression), and set up the list of unique blocks.
+static void DeduplicateBlocks(CompressLevel *level) {
+	level->unique_blocks = (int *)malloc(sizeof(int) * level->nu_blocks);
+	level->representatives = (int *)malloc(sizeof(int) * level->nu_blocks);
+	// Open addressing hash table of unique block indices.
+	int hash_table_size = 1;
+	while (hash_table_size < level->nu_blocks * 2)
+		hash_table_size *= 2;
+	int *hash_table = (int *)malloc(sizeof(int) * hash_table_size);
+	for (int i = 0; i < hash_table_size; i++)
+		hash_table[i] = - 1;
+	uint32_t *block_hashes = (uint32_t *)malloc(sizeof(uint32_t) * level->nu_blocks);
+	int nu_unique_blocks = 0;
+	for (int i = 0; i < level->nu_blocks; i++) {
+		uint8_t data[4 * 4 * 16];
+		int size = GetBlockComponentPixels(level, i, data) * 4;
+		uint32_t h = HashBlock(data, size);
+		int j = h & (hash_table_size - 1);
+		for (; hash_table[j] >= 0; j = (j + 1) & (hash_table_size - 1)) {
+			int k = hash_table[j];
+			if (block_hashes[k] != h)
+				continue;
+			uint8_t data_k[4 * 4 * 16];
+			GetBlockComponentPixels(level, k, data_k);
+			if (memcmp(data, data_k, size) == 0)
+				break;
+		}
+		if (hash_table[j] >= 0) {
+			level->representatives[i] = hash_table[j];
+			continue;
+		}
+		hash_table[j] = i;
+		block_hashes[i] = h;
+		level->representatives[i] = i;
+		level->unique_blocks[nu_unique_blocks] = i;
+		nu_unique_blocks++;
+	}
+	level->nu_unique_blocks = nu_unique_blocks;
+	free(hash_table);
+	free(block_hashes);
+}
+
+// Copy the compressed unique blocks to the blocks that are identical to them.
+static void CopyDuplicateBlocks(const CompressLevel *level, int block_size) {
+	for (int i = 0; i < level->nu_blocks; i++)
+		if (level->representatives[i] != i)
+			memcpy(level->pixel_buffer + i * level->block_stride,
+				level->pixel_buffer + level->representatives[i] * level->block_stride, block_size);
+}
+
+void detexSetDefaultCompressionParameters(detexCompressionParameters *params, uint32_t format) {
+	params->nu_tries = 1;
+	params->modal = detexGetModalDefault(format);
+	params->modes = NULL;
+	params->nu_generations = 2048;
+	params->nu_seed_generations = 256;
+	params->nu_stale_generations = 384;
+	params->max_threads = 0;
+	params->flags = DETEX_COMPRESS_FLAG_EXHAUSTIVE | DETEX_COMPRESS_FLAG_HYBRID;
+	params->seed = 0;
+	params->target_rmse = 0.0d;
+	params->isa = detexGetBestISA();
+	params->cache = NULL;
+	params->statistics = NULL;
+}
+
+// How a preset selects the modes.
+enum {
+	PRESET_MODES_NON_MODAL,
+	PRESET_MODES_DEFAULT,
+	PRESET_MODES_MODAL
+};
+
+struct CompressionPreset {
+	const char *name;
+	int nu_generations;
+	int nu_seed_generations;
+	int nu_stale_generations;
+	int nu_tries;
+	int mode_handling;
+	bool exhaustive;
+};
+
+// The normal preset corresponds to the default parameters. The faster presets shorten the
+// search (relying more on the analytic seeds) and ultrafast runs a single search in which the
+// seeding function picks the mode, rather than a search for each mode. The slower presets
+// lengthen the search and use more tries. From the normal preset on, the exhaustive search
+// (DETEX_COMPRESS_FLAG_EXHAUSTIVE) is faster than the evolutionary search for the formats
+// that support it. The table is shared by all formats: the format only selects the default
+// mode handling, and format-specific searches (such as the hybrid ETC1 search) scale the
+// schedule themselves.
+static const CompressionPreset compression_presets[DETEX_NU_COMPRESS_PRESETS] = {
+	{ "ultrafast", 128, 32, 0, 1, PRESET_MODES_NON_MODAL, false },
+	{ "fast", 512, 64, 64, 1, PRESET_MODES_DEFAULT, false },
+	{ "normal", 2048, 256, 384, 1, PRESET_MODES_DEFAULT, true },
+	{ "slow", 4096, 512, 768, 2, PRESET_MODES_DEFAULT, true },
+	{ "exhaustive", 8192, 1024, 1536, 4, PRESET_MODES_MODAL, true }
+};
+
+void detexSetCompressionPreset(detexCompressionParameters *params, int preset, uint32_t format) {
+	const CompressionPreset *p = &compression_presets[preset];
+	params->nu_generations = p->nu_generations;
+	params->nu_seed_generations = p->nu_seed_generations;
+	params->nu_stale_generations = p->nu_stale_generations;
+	params->nu_tries = p->nu_tries;
+	if (p->mode_handling == PRESET_MODES_NON_MODAL)
+		params->modal = false;
+	else if (p->mode_handling == PRESET_MODES_MODAL)
+		params->modal = true;
+	else
+		params->modal = detexGetModalDefault(format);
+	if (p->exhaustive)
+		params->flags |= DETEX_COMPRESS_FLAG_EXHAUSTIVE;
+	else
+		params->flags &= ~DETEX_COMPRESS_FLAG_EXHAUSTIVE;
+}
+
+const char *detexGetCompressionPresetName(int preset) {
+	return compression_presets[preset].name;
+}
+
+int detexGetBestISA() {
+#ifdef DETEX_AVX2_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return DETEX_ISA_AVX2;
+#endif
+	return DETEX_ISA_BASELINE;
+}
+
+bool detexISASupported(int isa) {
+	return isa >= 0 && isa <= detexGetBestISA();
+}
+
+static const char *detex_isa_names[DETEX_NU_ISAS] = {
+#ifdef __SSE2__
+	"sse2",
+#else
+	"generic",
+#endif
+	"avx2"
+};
+
+const char *detexGetISAName(int isa) {
+	return detex_isa_names[isa];
+}
+
+bool detexCompressTextures(const detexCompressionParameters *params, int nu_levels,
+const detexTexture * const *textures, uint8_t **pixel_buffers, uint32_t output_format) {
 	// Verify optional modes list.
 	int compressed_format_index = detexGetCompressedFormat(output_format);
-	if (modes != NULL) {
+	if (params->modes != NULL) {
 		int nu_modes = compression_info[compressed_format_index - 1].nu_modes;
-		if (!VerifyModes(modes, nu_modes)) {
+		if (!VerifyModes(params->modes, nu_modes)) {
 			printf("Invalid mode specified");
 			exit(1);
 		}
 	}
+	// Verify the search schedule; mutation requires at least one generation after seeding.
+	if (params->nu_seed_generations < 1 || params->nu_generations <= params->nu_seed_generations ||
+	params->nu_stale_generations < 0) {
+		printf("Invalid search schedule specified");
+		exit(1);
+	}
+	if (!detexISASupported(params->isa)) {
+		printf("Instruction set %s not supported", detexGetISAName(params->isa));
+		exit(1);
+	}
 	// Special handling for compressed texture formats that can be composited from compression
-	// of other formats.
+	// of other formats. For RGTC2, the red and green components are compressed separately
+	// using RGTC1, reading the components directly from the texture and storing the
+	// compressed components directly into their half of each block.
+	uint32_t component_format = output_format;
+	int nu_components = 1;
+	uint32_t component_pixel_format = 0;
 	if (output_format == DETEX_TEXTURE_FORMAT_RGTC2) {
 		// The input texture is in format DETEX_PIXEL_FORMAT_RG8.
-		// Create a temporary texture with just the red components.
-		int nu_pixels = texture->width * texture->height;
-		detexTexture temp_texture = *texture;
-		temp_texture.format = DETEX_PIXEL_FORMAT_R8;
-		temp_texture.data = (uint8_t *)malloc(nu_pixels);
-		for (int i = 0; i < nu_pixels; i++)
-			temp_texture.data[i] = texture->data[i * 2];
-		int nu_blocks = texture->width * texture->height / 16;
-		uint8_t *temp_pixel_buffer = (uint8_t *)malloc(nu_blocks * 8);
-		// Compress the red components.
-		detexCompressTexture(nu_tries, modal, max_threads, modes, &temp_texture, temp_pixel_buffer,
-			DETEX_TEXTURE_FORMAT_RGTC1);
-		for (int i = 0; i < nu_blocks; i++)
-			*(uint64_t *)(pixel_buffer + i * 16) = *(uint64_t *)(temp_pixel_buffer + i * 8);
-		// Create a temporary texture with just the green components.
-		for (int i = 0; i < nu_pixels; i++)
-			temp_texture.data[i] = texture->data[i * 2 + 1];
-		// Compress the green components.
-		detexCompressTexture(nu_tries, modal, max_threads, modes, &temp_texture, temp_pixel_buffer,
-			DETEX_TEXTURE_FORMAT_RGTC1);
-		free(temp_texture.data);
-		for (int i = 0; i < nu_blocks; i++)
-			*(uint64_t *)(pixel_buffer + i * 16 + 8) = *(uint64_t *)(temp_pixel_buffer + i * 8);
-		free(temp_pixel_buffer);
-		return true;
+		component_format = DETEX_TEXTURE_FORMAT_RGTC1;
+		nu_components = 2;
+		component_pixel_format = DETEX_PIXEL_FORMAT_R8;
 	}
 	else if (output_format == DETEX_TEXTURE_FORMAT_SIGNED_RGTC2) {
 		// The input texture is in format DETEX_PIXEL_FORMAT_SIGNED_RG16.
-		// Create a temporary texture with just the red components.
-		int nu_pixels = texture->width * texture->height;
-		detexTexture temp_texture = *texture;
-		temp_texture.format = DETEX_PIXEL_FORMAT_SIGNED_R16;
-		temp_texture.data = (uint8_t *)malloc(nu_pixels * 2);
-		for (int i = 0; i < nu_pixels; i++)
-			*(int16_t *)(temp_texture.data + i * 2) = *(int16_t *)(texture->data + i * 4);
-		int nu_blocks = texture->width * texture->height / 16;
-		uint8_t *temp_pixel_buffer = (uint8_t *)malloc(nu_blocks * 8);
-		// Compress the red components.
-		detexCompressTexture(nu_tries, modal, max_threads, modes, &temp_texture, temp_pixel_buffer,
-			DETEX_TEXTURE_FORMAT_SIGNED_RGTC1);
-		for (int i = 0; i < nu_blocks; i++)
-			*(uint64_t *)(pixel_buffer + i * 16) = *(uint64_t *)(temp_pixel_buffer + i * 8);
-		// Create a temporary texture with just the green components.
-		for (int i = 0; i < nu_pixels; i++)
-			*(int16_t *)(temp_texture.data + i * 2) = *(int16_t *)(texture->data + i * 4 + 2);
-		// Compress the green components.
-		detexCompressTexture(nu_tries, modal, max_threads, modes, &temp_texture, temp_pixel_buffer,
-			DETEX_TEXTURE_FORMAT_SIGNED_RGTC1);
-		free(temp_texture.data);
-		for (int i = 0; i < nu_blocks; i++)
-			*(uint64_t *)(pixel_buffer + i * 16 + 8) = *(uint64_t *)(temp_pixel_buffer + i * 8);
-		free(temp_pixel_buffer);
-		return true;
+		component_format = DETEX_TEXTURE_FORMAT_SIGNED_RGTC1;
+		nu_components = 2;
+		component_pixel_format = DETEX_PIXEL_FORMAT_SIGNED_R16;
 	}
-	// Calculate the number of blocks.
-	int nu_blocks = (texture->height / 4) * (texture->width / 4);
-	int nu_threads;
-	if (max_threads > 0)
-		nu_threads = max_threads;
-	else
-		// A number of threads higher than the number of CPU cores helps performance
-		// on PC-class devices.
-		nu_threads = sysconf(_SC_NPROCESSORS_CONF) * 2;
-	int nu_blocks_per_thread = nu_blocks / nu_threads;
-	if (nu_blocks_per_thread < 32) {
-		nu_threads = nu_blocks / 32;
-		if (nu_threads == 0)
-			nu_threads = 1;
+	int component_block_size = detexGetCompressedBlockSize(component_format);
+	int nu_task_levels = nu_levels * nu_components;
+	CompressLevel *levels = (CompressLevel *)malloc(sizeof(CompressLevel) * nu_task_levels);
+	int nu_blocks = 0;
+	for (int i = 0; i < nu_levels; i++)
+		for (int j = 0; j < nu_components; j++) {
+			int k = i * nu_components + j;
+			levels[k].texture = textures[i];
+			levels[k].pixel_buffer = pixel_buffers[i] + j * component_block_size;
+			levels[k].block_stride = component_block_size * nu_components;
+			levels[k].nu_blocks = (textures[i]->height / 4) * (textures[i]->width / 4);
+			levels[k].component = j;
+			if (nu_components == 1)
+				levels[k].pixel_format = textures[i]->format;
+			else
+				levels[k].pixel_format = component_pixel_format;
+			DeduplicateBlocks(&levels[k]);
+			nu_blocks += levels[k].nu_unique_blocks;
+		}
+	// Put the largest levels first, so that the small levels fill up the gaps at the end.
+	for (int i = 1; i < nu_task_levels; i++) {
+		CompressLevel level = levels[i];
+		int j = i;
+		for (; j > 0 && levels[j - 1].nu_unique_blocks < level.nu_unique_blocks; j--)
+			levels[j] = levels[j - 1];
+		levels[j] = level;
 	}
-	pthread_t *thread = (pthread_t *)malloc(sizeof(pthread_t) * nu_threads);
-	ThreadData *thread_data = (ThreadData *)malloc(sizeof(ThreadData) * nu_threads);
-	for (int i = 0; i < nu_threads; i++) {
-		thread_data[i].texture = texture;
-		thread_data[i].pixel_buffer = pixel_buffer;
-		thread_data[i].output_format = output_format;
-		thread_data[i].x_start = 0;
-		thread_data[i].y_start = i * texture->height / nu_threads;
-		thread_data[i].x_end = texture->width;
-		thread_data[i].y_end = (i + 1) * texture->height / nu_threads;
-		thread_data[i].nu_tries = nu_tries;
-		thread_data[i].modal = modal;
-		thread_data[i].modes = modes;
-		thread_data[i].rng = new dstCMWCRNG;
-		if (i < nu_threads - 1)
-			pthread_create(&thread[i], NULL, CompressBlocksThread, &thread_data[i]);
-		else
-			CompressBlocksThread(&thread_data[i]);			
+	CompressTask task;
+	task.nu_levels = nu_task_levels;
+	task.levels = levels;
+	task.output_format = component_format;
+	task.params = params;
+	task.nu_blocks = nu_blocks;
+	task.next_block = 0;
+	if (params->cache != NULL)
+		CalculateSettingsCacheKey(params, component_format, task.cache_seed);
+	task.nu_cache_lookups = 0;
+	task.nu_cache_hits = 0;
+	RunCompressTask(&task, params->max_threads);
+	if (params->statistics != NULL) {
+		params->statistics->nu_cache_lookups += task.nu_cache_lookups;
+		params->statistics->nu_cache_hits += task.nu_cache_hits;
+	}
+	for (int k = 0; k < nu_task_levels; k++) {
+		CopyDuplicateBlocks(&levels[k], component_block_size);
+		if (params->statistics != NULL) {
+			params->statistics->nu_blocks += levels[k].nu_blocks;
+			params->statistics->nu_unique_blocks += levels[k].nu_unique_blocks;
+		}
+		free(levels[k].unique_blocks);
+		free(levels[k].representatives);
 	}
-	for (int i = 0; i < nu_threads - 1; i++)
-		pthread_join(thread[i], NULL);
-	for (int i = 0; i < nu_threads; i++)
-		delete thread_data[i].rng;
-	free(thread_data);
-	free(thread);
+	free(levels);
 	return true;
 }
 
+bool detexCompressTexture(int nu_tries, bool modal, int max_threads, int *modes,
+const detexTexture * DETEX_RESTRICT texture, uint8_t * DETEX_RESTRICT pixel_buffer, uint32_t output_format) {
+	detexCompressionParameters params;
+	detexSetDefaultCompressionParameters(&params, output_format);
+	params.nu_tries = nu_tries;
+	params.modal = modal;
+	params.modes = modes;
+	params.max_threads = max_threads;
+	const detexTexture *textures[1] = { texture };
+	uint8_t *pixel_buffers[1] = { pixel_buffer };
+	return detexCompressTextures(&params, 1, textures, pixel_buffers, output_format);
+}
+
 // Compare and return RMSE.
 double detexCompareTextures(const detexTexture * DETEX_RESTRICT input_texture,
 detexTexture * DETEX_RESTRICT compressed_texture, double *average_rmse, double *rmse_sd) {
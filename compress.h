@@ -16,9 +16,137 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 */
 
+enum {
+	// Make the compressed output independent of the number of threads and of scheduling by
+	// seeding the random number generator for each block and try from the global seed,
+	// the level, the block position and the try index.
+	DETEX_COMPRESS_FLAG_DETERMINISTIC = 0x1,
+	// Find the optimal encoding by an exhaustive search, pruned to the encodings that can
+	// improve on the best one found so far, for the formats that have few enough encodings
+	// per block: RGTC1 (including the components of RGTC2) and the alpha of BC3. Set by
+	// default and by the presets from DETEX_COMPRESS_PRESET_NORMAL on.
+	DETEX_COMPRESS_FLAG_EXHAUSTIVE = 0x2,
+	// Encode blocks directly instead of searching, for textures that are generated and
+	// compressed at run time: RGTC1 (including the components of RGTC2) and the alpha of BC3
+	// from the minimum and maximum values, the colors of BC1, BC1A, BC2 and BC3 by a
+	// cluster fit and ETC1 by a search of each subblock. Overrides
+	// DETEX_COMPRESS_FLAG_EXHAUSTIVE.
+	DETEX_COMPRESS_FLAG_ANALYTIC = 0x4,
+	// For ETC1, let the search mutate only the base colors and select the best table codeword
+	// of each subblock exhaustively for every candidate. Each candidate is more expensive to
+	// evaluate, but the search space is much smaller and the search is shortened accordingly
+	// (to an eighth of the generations). Set by default.
+	DETEX_COMPRESS_FLAG_HYBRID = 0x8,
+};
+
+// Speed/quality presets, from fastest to highest quality (see detexSetCompressionPreset()).
+enum {
+	DETEX_COMPRESS_PRESET_ULTRAFAST = 0,
+	DETEX_COMPRESS_PRESET_FAST = 1,
+	DETEX_COMPRESS_PRESET_NORMAL = 2,
+	DETEX_COMPRESS_PRESET_SLOW = 3,
+	DETEX_COMPRESS_PRESET_EXHAUSTIVE = 4,
+	DETEX_NU_COMPRESS_PRESETS = 5
+};
+
+// Instruction sets of the SIMD kernels used for compression (see detexGetBestISA()).
+enum {
+	// The kernels the program was compiled for: SSE2 on x86 (part of the x86-64 baseline),
+	// otherwise scalar code.
+	DETEX_ISA_BASELINE = 0,
+	// AVX2 kernels, which are compiled with target attributes independently of the compiler
+	// flags and can only be selected when the CPU supports them.
+	DETEX_ISA_AVX2 = 1,
+	DETEX_NU_ISAS = 2
+};
+
+// Statistics of compression runs.
+struct detexCompressionStatistics {
+	// Number of blocks (for RGTC2, each component counts as a block).
+	int nu_blocks;
+	// Number of blocks that were compressed. Blocks that are byte-identical to an earlier
+	// block of the same level reuse the compressed result of that block.
+	int nu_unique_blocks;
+	// Number of blocks that were looked up in the block cache, and the number of those that
+	// were found.
+	int nu_cache_lookups;
+	int nu_cache_hits;
+};
+
+struct detexBlockCache;
+
+// Parameters that control compression.
+struct detexCompressionParameters {
+	// Number of tries per block.
+	int nu_tries;
+	// Whether a try is performed for each mode of the compression format.
+	bool modal;
+	// Optional list of modes terminated by -1, or NULL for all modes.
+	int *modes;
+	// Search schedule of each try: the minimum number of generations, the number of initial
+	// generations that use seeding rather than mutation, and the number of generations the
+	// search continues beyond the minimum as long as it keeps improving.
+	int nu_generations;
+	int nu_seed_generations;
+	int nu_stale_generations;
+	// Maximum number of threads, or zero to derive it from the number of CPU cores.
+	int max_threads;
+	// Combination of DETEX_COMPRESS_FLAG_* values.
+	uint32_t flags;
+	// Global seed for deterministic compression.
+	uint32_t seed;
+	// Stop searching for a better encoding of a block (including the remaining modes and
+	// tries) as soon as the block RMSE is at or below this value, in units of the pixel
+	// format used for compression. The default of zero only stops for lossless blocks.
+	double target_rmse;
+	// Instruction set of the SIMD kernels (DETEX_ISA_*). The default is detexGetBestISA().
+	int isa;
+	// Optional persistent block cache (see block-cache.h), or NULL. Blocks found in the cache
+	// skip the search, and the result of the search is added to the cache.
+	detexBlockCache *cache;
+	// Optional statistics, or NULL. The statistics of a run are added to the existing values.
+	detexCompressionStatistics *statistics;
+};
+
+// Set the default compression parameters for the given compressed format.
+void detexSetDefaultCompressionParameters(detexCompressionParameters *params, uint32_t format);
+
+// Apply a speed/quality preset, which sets the search schedule, the number of tries and
+// the mode handling for the given compressed format. The default parameters correspond to
+// DETEX_COMPRESS_PRESET_NORMAL.
+void detexSetCompressionPreset(detexCompressionParameters *params, int preset, uint32_t format);
+
+// Return the name of a preset (such as "normal").
+const char *detexGetCompressionPresetName(int preset);
+
+// Return the best instruction set supported by both the build and the CPU.
+int detexGetBestISA();
+
+// Return whether the instruction set can be used on this CPU.
+bool detexISASupported(int isa);
+
+// Return the name of an instruction set (such as "avx2").
+const char *detexGetISAName(int isa);
+
+// Start the pool of compression threads, which is reused by all subsequent compression calls.
+// When max_threads is zero, the number of threads is derived from the number of CPU cores.
+// Calling this function is optional; the pool is started on demand. Starting or stopping the
+// pool waits for a compression call that is running in another thread to complete.
+void detexStartCompressionThreads(int max_threads);
+
+// Stop the pool of compression threads.
+void detexStopCompressionThreads();
+
 bool detexCompressTexture(int nu_tries, bool modal, int max_threads, int *modes,
 	const detexTexture *texture, uint8_t *pixel_buffer, uint32_t output_format);
 
+// Compress several textures, usually the mipmap levels of a texture, in a single pass. The
+// blocks of all textures are put into one shared work queue (largest texture first), so that
+// all threads are kept busy until every level has been compressed. The compressed data for
+// textures[i] is written to pixel_buffers[i].
+bool detexCompressTextures(const detexCompressionParameters *params, int nu_levels,
+	const detexTexture * const *textures, uint8_t **pixel_buffers, uint32_t output_format);
+
 double detexCompareTextures(const detexTexture *input_texture, detexTexture *compressed_texture,
 	double *average_rmse, double *rmse_sd);
 
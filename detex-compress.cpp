@@ -29,6 +29,7 @@ OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "detex-png.h"
 #include "mipmaps.h"
 #include "compress.h"
+#include "block-cache.h"
 
 static uint32_t input_format;
 static uint32_t output_format;
@@ -37,8 +38,14 @@ static char *input_file;
 static char *output_file;
 static int output_file_type;
 static int nu_tries;
+static int preset;
 static int max_threads;
 static int *modes;
+static uint32_t seed;
+static double target_rmse;
+static char *cache_dir;
+static int cache_size;
+static int isa;
 
 static const uint32_t supported_formats[] = {
 	// Uncompressed formats.
@@ -110,6 +117,9 @@ enum {
 	OPTION_FLAG_MODAL = 0x10,
 	OPTION_FLAG_NON_MODAL = 0x20,
 	OPTION_FLAG_MIPMAPS = 0x40,
+	OPTION_FLAG_CONCURRENT_LEVELS = 0x80,
+	OPTION_FLAG_DETERMINISTIC = 0x100,
+	OPTION_FLAG_ANALYTIC = 0x200,
 };
 
 static const struct option long_options[] = {
@@ -121,10 +131,19 @@ static const struct option long_options[] = {
 	{ "quiet", no_argument, NULL, 'q' },
 	{ "modal", no_argument, NULL, 'm' },
 	{ "non-modal", no_argument, NULL, 'l' },
+	{ "preset", required_argument, NULL, 'a' },
 	{ "tries", required_argument, NULL, 't' },
 	{ "max-threads", required_argument, NULL, 'n' },
 	{ "mipmaps", no_argument, NULL, 'p' },
 	{ "modes", required_argument, NULL, 'e' },
+	{ "concurrent-levels", no_argument, NULL, 'c' },
+	{ "deterministic", no_argument, NULL, 'r' },
+	{ "seed", required_argument, NULL, 's' },
+	{ "target-rmse", required_argument, NULL, 'g' },
+	{ "cache-dir", required_argument, NULL, 'k' },
+	{ "cache-size", required_argument, NULL, 'z' },
+	{ "isa", required_argument, NULL, 'j' },
+	{ "analytic", no_argument, NULL, 'y' },
 	{ NULL, 0, NULL, 0 }
 };
 
@@ -228,11 +247,39 @@ static int *ParseModes(const char *str) {
 	return modes;
 }
 
+static int ParsePreset(const char *str) {
+	for (int i = 0; i < DETEX_NU_COMPRESS_PRESETS; i++)
+		if (strcasecmp(str, detexGetCompressionPresetName(i)) == 0)
+			return i;
+	FatalError("Fatal error: Preset %s not recognized\n", str);
+}
+
+// Parse an instruction set name, or "auto" (returned as -1) for the best supported one.
+static int ParseISA(const char *str) {
+	if (strcasecmp(str, "auto") == 0)
+		return - 1;
+	for (int i = 0; i < DETEX_NU_ISAS; i++)
+		if (strcasecmp(str, detexGetISAName(i)) == 0) {
+			if (!detexISASupported(i))
+				FatalError("Fatal error: Instruction set %s not supported by the CPU or the build\n",
+					str);
+			return i;
+		}
+	FatalError("Fatal error: Instruction set %s not recognized\n", str);
+}
+
 static void ParseArguments(int argc, char **argv) {
 	option_flags = 0;
-	nu_tries = 1;
+	preset = DETEX_COMPRESS_PRESET_NORMAL;
+	// A number of tries of zero selects the value of the preset.
+	nu_tries = 0;
 	max_threads = 0;
 	modes = NULL;
+	seed = 0;
+	target_rmse = 0.0d;
+	cache_dir = NULL;
+	cache_size = 256;
+	isa = - 1;
 	while (true) {
 		int option_index = 0;
 		int c = getopt_long(argc, argv, "f:o:i:q", long_options, &option_index);
@@ -260,6 +307,9 @@ static void ParseArguments(int argc, char **argv) {
 		case 'l' :
 			option_flags |= OPTION_FLAG_NON_MODAL;
 			break;
+		case 'a' :
+			preset = ParsePreset(optarg);
+			break;
 		case 't' :
 			nu_tries = atoi(optarg);
 			if (nu_tries < 1 || nu_tries >= 1024)
@@ -276,6 +326,35 @@ static void ParseArguments(int argc, char **argv) {
 		case 'e' :
 			modes = ParseModes(optarg);
 			break;
+		case 'c' :
+			option_flags |= OPTION_FLAG_CONCURRENT_LEVELS;
+			break;
+		case 'r' :
+			option_flags |= OPTION_FLAG_DETERMINISTIC;
+			break;
+		case 's' :
+			seed = strtoul(optarg, NULL, 0);
+			option_flags |= OPTION_FLAG_DETERMINISTIC;
+			break;
+		case 'g' :
+			target_rmse = atof(optarg);
+			if (target_rmse < 0.0d)
+				FatalError("Invalid value for target RMSE\n");
+			break;
+		case 'k' :
+			cache_dir = strdup(optarg);
+			break;
+		case 'z' :
+			cache_size = atoi(optarg);
+			if (cache_size < 1 || cache_size > 65536)
+				FatalError("Invalid value for block cache size\n");
+			break;
+		case 'j' :
+			isa = ParseISA(optarg);
+			break;
+		case 'y' :
+			option_flags |= OPTION_FLAG_ANALYTIC;
+			break;
 		default :
 			FatalError("");
 			break;
@@ -405,13 +484,19 @@ int main(int argc, char **argv) {
 			if (!detexCompressionSupported(output_format))
 				FatalError("Cannot convert to output format %s (detex-compress does not support " 						"compression to format)\n", detexGetTextureFormatText(output_format));
 			nu_levels = NumberOfLevels4x4OrLarger(input_textures, nu_levels);
-			Message("Tries per block: %d, ", nu_tries);
-			bool modal = detexGetModalDefault(output_format);
+			detexCompressionParameters params;
+			detexSetDefaultCompressionParameters(&params, output_format);
+			// Explicit options override the values of the preset.
+			detexSetCompressionPreset(&params, preset, output_format);
+			if (nu_tries > 0)
+				params.nu_tries = nu_tries;
 			if (option_flags & OPTION_FLAG_MODAL)
-				modal = true;
+				params.modal = true;
 			if (option_flags & OPTION_FLAG_NON_MODAL)
-				modal = false;
-			if (modal) {
+				params.modal = false;
+			Message("Preset: %s, tries per block: %d, ", detexGetCompressionPresetName(preset),
+				params.nu_tries);
+			if (params.modal) {
 				int nu_modes;
 				if (modes == NULL)
 					nu_modes = detexGetNumberOfModes(output_format);
@@ -423,17 +508,54 @@ int main(int argc, char **argv) {
 						modesp++;
 					}
 				}
-				Message("modal (%d modes), total tries per block: %d\n", nu_modes, nu_tries * nu_modes);
+				Message("modal (%d modes), total tries per block: %d\n", nu_modes,
+					params.nu_tries * nu_modes);
 			}
 			else
 				Message("non-modal\n");
+			params.modes = modes;
+			params.max_threads = max_threads;
+			params.target_rmse = target_rmse;
+			if (isa >= 0)
+				params.isa = isa;
+			Message("Instruction set: %s\n", detexGetISAName(params.isa));
+			if (target_rmse > 0.0d)
+				Message("Target block RMSE: %.3f\n", target_rmse);
+			detexCompressionStatistics statistics;
+			statistics.nu_blocks = 0;
+			statistics.nu_unique_blocks = 0;
+			statistics.nu_cache_lookups = 0;
+			statistics.nu_cache_hits = 0;
+			params.statistics = &statistics;
+			if (cache_dir != NULL) {
+				params.cache = detexOpenBlockCache(cache_dir, (uint64_t)cache_size * 1024 * 1024);
+				if (params.cache == NULL)
+					FatalError("Could not open block cache in %s\n", cache_dir);
+				Message("Block cache: %s (%d MB)\n", cache_dir, cache_size);
+			}
+			if (option_flags & OPTION_FLAG_ANALYTIC) {
+				params.flags |= DETEX_COMPRESS_FLAG_ANALYTIC;
+				Message("Analytic encoding (BC1, BC1A, BC2, BC3, RGTC1, RGTC2 and ETC1)\n");
+			}
+			if (option_flags & OPTION_FLAG_DETERMINISTIC) {
+				params.flags |= DETEX_COMPRESS_FLAG_DETERMINISTIC;
+				params.seed = seed;
+				Message("Deterministic compression, seed %u\n", seed);
+			}
+			// Start the compression threads once; they are reused for every level.
+			detexStartCompressionThreads(max_threads);
+			// Convert the input levels to the pixel format used for compression and
+			// allocate the output levels.
+			uint32_t pixel_format_for_compression = detexGetPixelFormat(output_format);
+			detexTexture **adjusted_input_textures = (detexTexture **)malloc(
+				sizeof(detexTexture *) * nu_levels);
+			uint8_t **output_pixel_buffers = (uint8_t **)malloc(sizeof(uint8_t *) * nu_levels);
 			for (int i = 0; i < nu_levels; i++) {
 				if ((input_textures[i]->width & 3) != 0 || (input_textures[i]->height & 3) != 0)
 					FatalError("Input texture dimensions must be multiple of four for compression\n");
 				detexTexture *adjusted_input_texture;
 				adjusted_input_texture = (detexTexture *)malloc(sizeof(detexTexture));
 				*adjusted_input_texture = *input_textures[i];
-				uint32_t pixel_format_for_compression = detexGetPixelFormat(output_format);
 				if (input_textures[i]->format != pixel_format_for_compression) {
 					adjusted_input_texture->data = (uint8_t *)malloc(
 						detexGetPixelSize(pixel_format_for_compression) *
@@ -444,28 +566,53 @@ int main(int argc, char **argv) {
 					if (!r)
 						FatalError("%s\n", detexGetErrorMessage());
 				}
+				adjusted_input_textures[i] = adjusted_input_texture;
 				uint32_t size = detexGetCompressedBlockSize(output_format) * input_textures[i]->width *
 					input_textures[i]->height / 16;
 				output_textures[i] = (detexTexture *)malloc(sizeof(detexTexture));
 				output_textures[i]->data = (uint8_t *)malloc(size); 
-				bool r = detexCompressTexture(nu_tries, modal, max_threads, modes,
-					adjusted_input_texture, output_textures[i]->data, output_format);
-				if (!r)
-					FatalError("Error compressing texture");
 				output_textures[i]->format = output_format;
 				output_textures[i]->width = input_textures[i]->width;
 				output_textures[i]->height = input_textures[i]->height;
 				output_textures[i]->width_in_blocks = input_textures[i]->width / 4;
 				output_textures[i]->height_in_blocks = input_textures[i]->height / 4;
+				output_pixel_buffers[i] = output_textures[i]->data;
+			}
+			if (option_flags & OPTION_FLAG_CONCURRENT_LEVELS) {
+				// Compress the blocks of all levels from a single work queue.
+				bool r = detexCompressTextures(&params, nu_levels, adjusted_input_textures,
+					output_pixel_buffers, output_format);
+				if (!r)
+					FatalError("Error compressing texture");
+			}
+			for (int i = 0; i < nu_levels; i++) {
+				if (!(option_flags & OPTION_FLAG_CONCURRENT_LEVELS)) {
+					bool r = detexCompressTextures(&params, 1, &adjusted_input_textures[i],
+						&output_pixel_buffers[i], output_format);
+					if (!r)
+						FatalError("Error compressing texture");
+				}
 				double average_rmse, rmse_sd;
-				double rmse = detexCompareTextures(adjusted_input_texture, output_textures[i],
+				double rmse = detexCompareTextures(adjusted_input_textures[i], output_textures[i],
 					&average_rmse, &rmse_sd);
 				Message("Root-mean-square error (RMSE) per pixel: %.3f\n", rmse);
 				Message("Block RMSE average: %.3f, SD: %.3f\n", average_rmse, rmse_sd);
 				if (input_textures[i]->format != pixel_format_for_compression)
-					free(adjusted_input_texture->data);
-				free(adjusted_input_texture);
+					free(adjusted_input_textures[i]->data);
+				free(adjusted_input_textures[i]);
+			}
+			Message("Unique blocks: %d of %d (deduplication ratio %.2f)\n", statistics.nu_unique_blocks,
+				statistics.nu_blocks, statistics.nu_unique_blocks == 0 ? 1.0d :
+				(double)statistics.nu_blocks / statistics.nu_unique_blocks);
+			if (params.cache != NULL) {
+				Message("Block cache hits: %d of %d lookups (%.1f%%)\n", statistics.nu_cache_hits,
+					statistics.nu_cache_lookups, statistics.nu_cache_lookups == 0 ? 0.0d :
+					statistics.nu_cache_hits * 100.0d / statistics.nu_cache_lookups);
+				detexCloseBlockCache(params.cache);
 			}
+			free(adjusted_input_textures);
+			free(output_pixel_buffers);
+			detexStopCompressionThreads();
 		}
 		else {
 			for (int i = 0; i < nu_levels; i++) {